@@ -0,0 +1,139 @@
+/*
+ * Log appending benchmark
+ *
+ * A number of threads (1000 by default, or the first argument) each append
+ * LINES lines of LINE_SIZE bytes to the same log file, opened with O_APPEND,
+ * through uthread_write(). A regular file cannot be polled, so without
+ * io_uring every append is a write() made by a helper kernel thread through
+ * uthread_offload(), which costs a round trip between kernel threads. With
+ * io_uring, each append is queued in the ring, and the worker submits the
+ * appends of the threads waiting at once, with a single system call, on a
+ * scheduling pass once 32 of them are queued, or when it runs out of threads to
+ * run.
+ *
+ * The file must end up holding every line, whole.
+ *
+ * The CPU time includes the helper kernel threads and the kernel's io_uring
+ * workers.
+ *
+ * Output (numbers vary):
+ * mode         appends/s  cpu_ns/append
+ * offload         326575         3041.6
+ * io_uring        898628         1104.9
+ */
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <netpoll.h>
+#include <uthread.h>
+
+#define THREADS 1000
+#define LINES 200
+#define LINE_SIZE 64
+
+static unsigned long threads = THREADS;
+static int logFd;
+
+static double now_ns(clockid_t clock)
+{
+	struct timespec ts;
+
+	clock_gettime(clock, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void check(bool ok, const char *what)
+{
+	if (!ok) {
+		perror(what);
+		exit(1);
+	}
+}
+
+static void shipper(void *arg)
+{
+	char line[LINE_SIZE];
+
+	snprintf(line, sizeof(line), "%-*lu\n", LINE_SIZE - 2, (long)arg);
+
+	for (int i = 0; i < LINES; i++)
+		check(uthread_write(logFd, line, sizeof(line)) == sizeof(line),
+		      "uthread_write");
+}
+
+static void spawner(void *arg)
+{
+	(void)arg;
+
+	for (unsigned long i = 0; i < threads; i++)
+		check(uthread_create(shipper, (void *)i) >= 0, "uthread_create");
+}
+
+static void run(const char *mode)
+{
+	char path[] = "/tmp/append_bench.XXXXXX";
+	double start, cpu;
+	struct stat st;
+	int fd;
+
+	/* The file is opened again with O_APPEND */
+	fd = mkstemp(path);
+	check(fd >= 0, "mkstemp");
+	logFd = open(path, O_WRONLY | O_APPEND);
+	check(logFd >= 0, "open");
+	close(fd);
+	unlink(path);
+
+	start = now_ns(CLOCK_MONOTONIC);
+	cpu = now_ns(CLOCK_PROCESS_CPUTIME_ID);
+	uthread_run(false, spawner, NULL);
+	cpu = now_ns(CLOCK_PROCESS_CPUTIME_ID) - cpu;
+	start = now_ns(CLOCK_MONOTONIC) - start;
+
+	check(fstat(logFd, &st) == 0, "fstat");
+	if ((unsigned long)st.st_size != threads * LINES * LINE_SIZE) {
+		printf("%s: %lld bytes written\n", mode, (long long)st.st_size);
+		exit(1);
+	}
+	uthread_close(logFd);
+
+	printf("%-10s %11.0f %14.1f\n", mode,
+	       threads * LINES / (start / 1e9), cpu / (threads * LINES));
+}
+
+static unsigned long get_argv(char *argv)
+{
+	long int ret = strtol(argv, NULL, 0);
+
+	if (ret == LONG_MIN || ret == LONG_MAX || ret <= 0) {
+		perror("strtol");
+		exit(1);
+	}
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc > 1)
+		threads = get_argv(argv[1]);
+
+	printf("%-10s %11s %14s\n", "mode", "appends/s", "cpu_ns/append");
+	run("offload");
+
+	if (uthread_set_io_uring(true)) {
+		printf("io_uring unavailable\n");
+		return 0;
+	}
+	run("io_uring");
+
+	return 0;
+}
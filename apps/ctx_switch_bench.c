@@ -0,0 +1,148 @@
+/*
+ * Context switch benchmark
+ *
+ * Measures the latency of a single context switch with the backend libuthread
+ * was built with (see `make CTX=...`), next to glibc's swapcontext() and to a
+ * full uthread_yield() between two threads. Each measurement ping-pongs
+ * between two contexts for a number of rounds (1000000 by default, or the
+ * first argument).
+ *
+ * Output (numbers vary):
+ * backend                  ns/switch
+ * uthread_ctx (asm)             18.6
+ * swapcontext                  364.6
+ * uthread_yield                495.8
+ */
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <ucontext.h>
+
+#include <uthread.h>
+
+#include "../libuthread/private.h"
+
+#define ROUNDS 1000000
+#define BENCH_STACK_SIZE 32768
+
+static unsigned long rounds = ROUNDS;
+
+static uthread_ctx_t mainCtx, partnerCtx;
+static ucontext_t mainUctx, partnerUctx;
+
+static double now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Partner of the uthread_ctx_switch() ping-pong, never returns */
+static void ctx_partner(void *arg)
+{
+	(void)arg;
+
+	while (1)
+		uthread_ctx_switch(&partnerCtx, &mainCtx);
+}
+
+/* Partner of the swapcontext() ping-pong, never returns */
+static void ucontext_partner(void)
+{
+	while (1)
+		swapcontext(&partnerUctx, &mainUctx);
+}
+
+static double bench_ctx(void)
+{
+	void *stack = uthread_ctx_alloc_stack(UTHREAD_STACK_SIZE, 0);
+	double start;
+	unsigned long i;
+
+	uthread_ctx_init(&partnerCtx, stack, UTHREAD_STACK_SIZE, ctx_partner, NULL);
+
+	start = now_ns();
+	for (i = 0; i < rounds; i++)
+		uthread_ctx_switch(&mainCtx, &partnerCtx);
+
+	return (now_ns() - start) / (2.0 * rounds);
+}
+
+static double bench_ucontext(void)
+{
+	void *stack = malloc(BENCH_STACK_SIZE);
+	double start;
+	unsigned long i;
+
+	getcontext(&partnerUctx);
+	partnerUctx.uc_stack.ss_sp = stack;
+	partnerUctx.uc_stack.ss_size = BENCH_STACK_SIZE;
+	makecontext(&partnerUctx, ucontext_partner, 0);
+
+	start = now_ns();
+	for (i = 0; i < rounds; i++)
+		swapcontext(&mainUctx, &partnerUctx);
+
+	return (now_ns() - start) / (2.0 * rounds);
+}
+
+static double yieldStart, yieldEnd;
+
+static void yield_partner(void *arg)
+{
+	unsigned long i;
+	(void)arg;
+
+	for (i = 0; i < rounds; i++)
+		uthread_yield();
+}
+
+static void yield_main(void *arg)
+{
+	unsigned long i;
+	(void)arg;
+
+	uthread_create(yield_partner, NULL);
+
+	yieldStart = now_ns();
+	for (i = 0; i < rounds; i++)
+		uthread_yield();
+	yieldEnd = now_ns();
+}
+
+static unsigned long get_argv(char *argv)
+{
+	long int ret = strtol(argv, NULL, 0);
+
+	if (ret == LONG_MIN || ret == LONG_MAX || ret <= 0) {
+		perror("strtol");
+		exit(1);
+	}
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	double ctxNs, ucontextNs;
+	char label[32];
+
+	if (argc > 1)
+		rounds = get_argv(argv[1]);
+
+	ctxNs = bench_ctx();
+	ucontextNs = bench_ucontext();
+	uthread_run(false, yield_main, NULL);
+
+	printf("%-24s %9s\n", "backend", "ns/switch");
+	snprintf(label, sizeof(label), "uthread_ctx (%s)", UTHREAD_CTX_BACKEND);
+	printf("%-24s %9.1f\n", label, ctxNs);
+	printf("%-24s %9.1f\n", "swapcontext", ucontextNs);
+	printf("%-24s %9.1f\n", "uthread_yield",
+	       (yieldEnd - yieldStart) / (2.0 * rounds));
+
+	return 0;
+}
@@ -0,0 +1,245 @@
+/*
+ * Echo server benchmark
+ *
+ * A thread-per-connection echo server, written with blocking calls, serves a
+ * number of connections (10000 by default, or the first argument) over
+ * loopback on a single worker. The clients run in a child process, also a
+ * thread per connection on a single worker. Once every connection is up, each
+ * client sends ROUNDS messages of MSG_SIZE bytes and waits for each one to come
+ * back.
+ *
+ * The latency is high because all the clients send at once: a message waits
+ * for the other 9999 to be served.
+ *
+ * Every thread blocks in uthread_read() or uthread_write() whenever its socket
+ * is not ready, so that the other threads run, and a worker left with nothing
+ * to run waits in epoll for the sockets to become ready. A process therefore
+ * holds a single kernel thread however many connections it serves.
+ *
+ * Output (numbers vary):
+ * connections   requests/s  latency_us
+ * 10000              36654    256823.3
+ */
+
+#include <arpa/inet.h>
+#include <limits.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <netpoll.h>
+#include <sem.h>
+#include <uthread.h>
+
+#define CONNECTIONS 10000
+#define ROUNDS 20
+#define MSG_SIZE 64
+
+static unsigned long connections = CONNECTIONS;
+static struct sockaddr_in server;
+static int listenFd;
+
+/* Clients */
+static unsigned long connected, finished;
+static sem_t go;
+static double start, elapsed, latency;
+
+static double now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void check(bool ok, const char *what)
+{
+	if (!ok) {
+		perror(what);
+		exit(1);
+	}
+}
+
+/* Read exactly @count bytes, returns false at end of file */
+static bool read_all(int fd, char *buf, size_t count)
+{
+	while (count) {
+		ssize_t ret = uthread_read(fd, buf, count);
+
+		check(ret >= 0, "uthread_read");
+		if (ret == 0)
+			return false;
+		buf += ret;
+		count -= ret;
+	}
+	return true;
+}
+
+static void write_all(int fd, const char *buf, size_t count)
+{
+	while (count) {
+		ssize_t ret = uthread_write(fd, buf, count);
+
+		check(ret >= 0, "uthread_write");
+		buf += ret;
+		count -= ret;
+	}
+}
+
+static void handler(void *arg)
+{
+	int fd = (long)arg;
+	char buf[MSG_SIZE];
+
+	while (read_all(fd, buf, sizeof(buf)))
+		write_all(fd, buf, sizeof(buf));
+
+	uthread_close(fd);
+}
+
+static void acceptor(void *arg)
+{
+	uthread_attr_t attr;
+	(void)arg;
+
+	uthread_attr_init(&attr);
+	attr.stack_size = 16384;
+	attr.guard_size = 0;
+
+	for (unsigned long i = 0; i < connections; i++) {
+		int fd = uthread_accept(listenFd, NULL, NULL);
+		uthread_tid_t tid;
+
+		check(fd >= 0, "uthread_accept");
+		tid = uthread_create_attr(handler, (void *)(long)fd, &attr);
+		check(tid >= 0 && uthread_detach(tid) == 0, "uthread_create");
+	}
+
+	uthread_close(listenFd);
+}
+
+static void client(void *arg)
+{
+	char buf[MSG_SIZE];
+	int one = 1;
+	int fd;
+	(void)arg;
+
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	check(fd >= 0, "socket");
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	check(uthread_connect(fd, (struct sockaddr *)&server,
+			      sizeof(server)) == 0, "uthread_connect");
+
+	/* Only time the echoes, once all the connections are up */
+	if (++connected == connections) {
+		start = now_ns();
+		for (unsigned long i = 1; i < connections; i++)
+			sem_up(go);
+	} else {
+		sem_down(go);
+	}
+
+	memset(buf, 'x', sizeof(buf));
+	for (int i = 0; i < ROUNDS; i++) {
+		double sent = now_ns();
+
+		write_all(fd, buf, sizeof(buf));
+		check(read_all(fd, buf, sizeof(buf)), "connection closed");
+		latency += now_ns() - sent;
+	}
+
+	if (++finished == connections)
+		elapsed = now_ns() - start;
+
+	uthread_close(fd);
+}
+
+static void clients(void *arg)
+{
+	uthread_attr_t attr;
+	(void)arg;
+
+	uthread_attr_init(&attr);
+	attr.stack_size = 16384;
+	attr.guard_size = 0;
+
+	for (unsigned long i = 0; i < connections; i++) {
+		uthread_tid_t tid = uthread_create_attr(client, NULL, &attr);
+
+		check(tid >= 0 && uthread_detach(tid) == 0, "uthread_create");
+	}
+}
+
+static unsigned long get_argv(char *argv)
+{
+	long int ret = strtol(argv, NULL, 0);
+
+	if (ret == LONG_MIN || ret == LONG_MAX || ret <= 0) {
+		perror("strtol");
+		exit(1);
+	}
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	socklen_t len = sizeof(server);
+	struct rlimit rl;
+	int status;
+	pid_t pid;
+
+	if (argc > 1)
+		connections = get_argv(argv[1]);
+
+	/* Each process holds one socket per connection */
+	check(getrlimit(RLIMIT_NOFILE, &rl) == 0, "getrlimit");
+	rl.rlim_cur = rl.rlim_max;
+	setrlimit(RLIMIT_NOFILE, &rl);
+	if (connections + 16 > rl.rlim_cur) {
+		printf("at most %lu connections allowed\n",
+		       (unsigned long)rl.rlim_cur - 16);
+		return 1;
+	}
+
+	listenFd = socket(AF_INET, SOCK_STREAM, 0);
+	check(listenFd >= 0, "socket");
+	server.sin_family = AF_INET;
+	server.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	check(bind(listenFd, (struct sockaddr *)&server, sizeof(server)) == 0,
+	      "bind");
+	check(listen(listenFd, SOMAXCONN) == 0, "listen");
+	check(getsockname(listenFd, (struct sockaddr *)&server, &len) == 0,
+	      "getsockname");
+
+	pid = fork();
+	check(pid >= 0, "fork");
+
+	if (pid == 0) {
+		close(listenFd);
+		go = sem_create(0);
+		uthread_run(false, clients, NULL);
+		sem_destroy(go);
+
+		printf("%-12s %11s %11s\n", "connections", "requests/s",
+		       "latency_us");
+		printf("%-12lu %11.0f %11.1f\n", connections,
+		       connections * ROUNDS / (elapsed / 1e9),
+		       latency / (connections * ROUNDS) / 1e3);
+		return 0;
+	}
+
+	uthread_run(false, acceptor, NULL);
+
+	check(waitpid(pid, &status, 0) == pid, "waitpid");
+	return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+}
@@ -0,0 +1,94 @@
+/*
+ * Per-thread memory footprint benchmark
+ *
+ * Creates a number of threads (10000 by default, or the first argument) that
+ * all block on a semaphore, and reports how much the process grew per blocked
+ * thread, both in address space and in resident memory, as seen in
+ * /proc/self/statm.
+ *
+ * Output (numbers vary):
+ * 10000 threads: 36.0 KiB virtual, 4.1 KiB resident per thread
+ */
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <sem.h>
+#include <uthread.h>
+
+#define THREADS 10000
+
+static unsigned int count = THREADS;
+static sem_t gate;
+
+/* Read the virtual and resident size of the process (in pages) */
+static void statm(long *size, long *resident)
+{
+	FILE *f = fopen("/proc/self/statm", "r");
+
+	if (!f || fscanf(f, "%ld %ld", size, resident) != 2) {
+		perror("statm");
+		exit(1);
+	}
+	fclose(f);
+}
+
+static void blocked(void *arg)
+{
+	(void)arg;
+
+	sem_down(gate);
+}
+
+static void spawner(void *arg)
+{
+	long size0, resident0, size1, resident1;
+	double kib = sysconf(_SC_PAGESIZE) / 1024.0;
+	(void)arg;
+
+	statm(&size0, &resident0);
+
+	for (unsigned int i = 0; i < count; i++) {
+		if (uthread_create(blocked, NULL) < 0) {
+			printf("uthread_create failed after %u threads\n", i);
+			exit(1);
+		}
+	}
+
+	/* Let every thread run until it blocks */
+	uthread_yield();
+
+	statm(&size1, &resident1);
+	printf("%u threads: %.1f KiB virtual, %.1f KiB resident per thread\n",
+	       count, (size1 - size0) * kib / count,
+	       (resident1 - resident0) * kib / count);
+
+	for (unsigned int i = 0; i < count; i++)
+		sem_up(gate);
+}
+
+static unsigned int get_argv(char *argv)
+{
+	long int ret = strtol(argv, NULL, 0);
+
+	if (ret == LONG_MIN || ret == LONG_MAX || ret <= 0) {
+		perror("strtol");
+		exit(1);
+	}
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc > 1)
+		count = get_argv(argv[1]);
+
+	gate = sem_create(0);
+	uthread_run(false, spawner, NULL);
+	sem_destroy(gate);
+
+	return 0;
+}
@@ -0,0 +1,120 @@
+/*
+ * Offloading benchmark
+ *
+ * BLOCKERS threads each make CALLS calls that block for CALL_MS ms (a sleep
+ * standing for an fsync() on slow storage), while a ticker thread wakes up
+ * every millisecond, on a single worker. Made directly, each call stalls the
+ * worker, and the ticker with it. Made through uthread_offload(), the calls
+ * run on the helper kernel threads (four of them, so four calls at a time)
+ * and the ticker keeps its pace. Without preemption, the blockers never yield
+ * when their calls are made directly, so the ticker only wakes up once they
+ * are all done.
+ *
+ * Output (numbers vary):
+ * mode         total_ms     late_us  max_late_us
+ * direct         1610.5   1609198.1    1609198.1
+ * offload         405.1       183.5       1321.1
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include <uthread.h>
+
+#define BLOCKERS 8
+#define CALLS 10
+#define CALL_MS 20
+
+static bool offload;
+static int blockers;
+static unsigned long ticks;
+static double late, maxLate;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void *slow_call(void *arg)
+{
+	struct timespec ts = { 0, CALL_MS * 1000000L };
+	(void)arg;
+
+	nanosleep(&ts, NULL);
+	return NULL;
+}
+
+static void blocker(void *arg)
+{
+	(void)arg;
+
+	for (int i = 0; i < CALLS; i++) {
+		if (offload)
+			uthread_offload(slow_call, NULL);
+		else
+			slow_call(NULL);
+	}
+	blockers--;
+}
+
+static void ticker(void *arg)
+{
+	uint64_t deadline = now_ns();
+	(void)arg;
+
+	while (blockers) {
+		double ns;
+
+		deadline += 1000000;
+		uthread_sleep_until(deadline);
+		ns = now_ns() - deadline;
+		late += ns;
+		if (ns > maxLate)
+			maxLate = ns;
+		ticks++;
+
+		/* Do not catch up on the ticks missed */
+		if (now_ns() > deadline)
+			deadline = now_ns();
+	}
+}
+
+static void spawner(void *arg)
+{
+	(void)arg;
+
+	blockers = BLOCKERS;
+	uthread_create(ticker, NULL);
+	for (int i = 0; i < BLOCKERS; i++)
+		uthread_create(blocker, NULL);
+}
+
+static void run(const char *mode, bool use_offload)
+{
+	uint64_t start;
+
+	offload = use_offload;
+	ticks = 0;
+	late = maxLate = 0;
+
+	start = now_ns();
+	uthread_run(false, spawner, NULL);
+
+	printf("%-10s %10.1f %11.1f %12.1f\n", mode, (now_ns() - start) / 1e6,
+	       late / ticks / 1e3, maxLate / 1e3);
+}
+
+int main(void)
+{
+	printf("%-10s %10s %11s %12s\n", "mode", "total_ms", "late_us",
+	       "max_late_us");
+	run("direct", false);
+	run("offload", true);
+
+	return 0;
+}
@@ -0,0 +1,129 @@
+/*
+ * Preemption time slice test
+ *
+ * Runs two threads that spin without ever yielding, with preemption enabled,
+ * for a few configurations of the time slice. Every time one of the threads
+ * notices that the other one ran since it last looked, it counts a switch. The
+ * measured slice is the elapsed time divided by the number of switches, and
+ * should be close to the configured one, except for CPU time slices shorter
+ * than the kernel's scheduler tick, which are rounded up to the tick.
+ *
+ * Then a single thread runs a fixed amount of computation, with and without
+ * preemption (100 us slices). With nobody to preempt it for, the timer should
+ * not even be armed, so the overhead of preemption should be close to 0.
+ *
+ * Output (numbers vary):
+ * clock      quantum_us  measured_us
+ * cpu             10000       9803.9
+ * monotonic        1000       1028.8
+ * monotonic         100        107.0
+ * cpu               100       4065.0
+ * alone: 0.1% overhead
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <uthread.h>
+
+/* Wall-clock time each configuration runs for (in ms) */
+#define RUN_MS 500
+
+/* Computation of the single thread */
+#define ALONE_WORK 200000000UL
+
+static volatile int lastRunner;
+static unsigned long switches;
+static double deadline;
+static volatile unsigned long sink;
+
+static double now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void spinner(void *arg)
+{
+	int me = (int)(long)arg;
+
+	while (now_us() < deadline) {
+		if (lastRunner != me) {
+			lastRunner = me;
+			switches++;
+		}
+	}
+}
+
+static void start(void *arg)
+{
+	(void)arg;
+
+	uthread_create(spinner, (void *)2L);
+	spinner((void *)1L);
+}
+
+static void run(uthread_clock_t clock, unsigned long quantum)
+{
+	double begin;
+
+	if (uthread_set_preemption(quantum, clock)) {
+		printf("uthread_set_preemption failed\n");
+		exit(1);
+	}
+
+	lastRunner = 0;
+	switches = 0;
+	begin = now_us();
+	deadline = begin + RUN_MS * 1000;
+	uthread_run(true, start, NULL);
+
+	printf("%-10s %10lu %12.1f\n",
+	       clock == UTHREAD_CLOCK_CPU ? "cpu" : "monotonic", quantum,
+	       switches ? (deadline - begin) / switches : 0.0);
+}
+
+static void alone(void *arg)
+{
+	unsigned long x = 1;
+	(void)arg;
+
+	for (unsigned long i = 0; i < ALONE_WORK; i++)
+		x = x * 6364136223846793005UL + 1442695040888963407UL;
+	sink = x;
+}
+
+static double run_alone(bool preempt)
+{
+	double begin = now_us();
+
+	uthread_run(preempt, alone, NULL);
+	return now_us() - begin;
+}
+
+int main(void)
+{
+	/* Invalid configurations */
+	if (uthread_set_preemption(0, UTHREAD_CLOCK_CPU) != -1 ||
+	    uthread_set_preemption(100, (uthread_clock_t)42) != -1) {
+		printf("invalid configuration accepted\n");
+		exit(1);
+	}
+
+	printf("%-10s %10s %12s\n", "clock", "quantum_us", "measured_us");
+	run(UTHREAD_CLOCK_CPU, 10000);
+	run(UTHREAD_CLOCK_MONOTONIC, 1000);
+	run(UTHREAD_CLOCK_MONOTONIC, 100);
+	run(UTHREAD_CLOCK_CPU, 100);
+
+	uthread_set_preemption(100, UTHREAD_CLOCK_MONOTONIC);
+	double off = run_alone(false);
+	double on = run_alone(true);
+	printf("alone: %.1f%% overhead\n", (on - off) * 100 / off);
+
+	return 0;
+}
@@ -1,8 +1,10 @@
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
 
 #include "../libuthread/queue.h"
+#include "../libuthread/ring.h"
 
 #define TEST_ASSERT(assert)				\
 do {									\
@@ -270,6 +272,222 @@ void test_delete(void)
 	TEST_ASSERT(queue_length(q1) == 0);
 }
 
+/**
+ * @brief Test ring_enqueue() and ring_dequeue(), including growing the ring
+ * while its items wrap around the end of the array
+ */
+void test_ring_simple(void)
+{
+	ring_t r;
+	int data[100];
+	int *ptr;
+	int i;
+	int ok = 1;
+
+	r = ring_create();
+	TEST_ASSERT(r != NULL);
+
+	/* Move the head forward so that the items wrap when growing */
+	for (i = 0; i < 10; i++)
+		ring_enqueue(r, &data[i]);
+	for (i = 0; i < 10; i++)
+		ring_dequeue(r, (void**)&ptr);
+
+	for (i = 0; i < 100; i++)
+		ring_enqueue(r, &data[i]);
+	TEST_ASSERT(ring_length(r) == 100);
+
+	for (i = 0; i < 100; i++)
+	{
+		ring_dequeue(r, (void**)&ptr);
+		ok = ok && ptr == &data[i];
+	}
+	TEST_ASSERT(ok);
+	TEST_ASSERT(ring_destroy(r) == 0);
+}
+
+/**
+ * @brief Test all possible returns of the ring_t functions on bad parameters
+ */
+void test_ring_errors(void)
+{
+	ring_t r;
+	int data = 3;
+	void *ptr;
+	void *items[2] = {&data, NULL};
+
+	r = ring_create();
+
+	/* null ring */
+	TEST_ASSERT(ring_enqueue(NULL, &data) == -1);
+	TEST_ASSERT(ring_dequeue(NULL, &ptr) == -1);
+	TEST_ASSERT(ring_length(NULL) == -1);
+	TEST_ASSERT(ring_destroy(NULL) == -1);
+
+	/* null data */
+	TEST_ASSERT(ring_enqueue(r, NULL) == -1);
+	TEST_ASSERT(ring_dequeue(r, NULL) == -1);
+
+	/* empty ring */
+	TEST_ASSERT(ring_dequeue(r, &ptr) == -1);
+
+	/* null item in bulk enqueue, nothing is enqueued */
+	TEST_ASSERT(ring_enqueue_n(r, items, 2) == -1);
+	TEST_ASSERT(ring_length(r) == 0);
+
+	/* non-empty ring */
+	ring_enqueue(r, &data);
+	TEST_ASSERT(ring_destroy(r) == -1);
+}
+
+/**
+ * @brief Test ring_enqueue_n() and ring_dequeue_n()
+ */
+void test_ring_bulk(void)
+{
+	ring_t r;
+	int data[50];
+	void *items[50];
+	void *out[64];
+	int i;
+	int ok = 1;
+
+	for (i = 0; i < 50; i++)
+		items[i] = &data[i];
+
+	r = ring_create();
+	TEST_ASSERT(ring_enqueue_n(r, items, 50) == 50);
+	TEST_ASSERT(ring_length(r) == 50);
+
+	/* Partial bulk dequeue */
+	TEST_ASSERT(ring_dequeue_n(r, out, 20) == 20);
+	for (i = 0; i < 20; i++)
+		ok = ok && out[i] == &data[i];
+
+	/* Bulk dequeue of more items than available */
+	TEST_ASSERT(ring_dequeue_n(r, out, 64) == 30);
+	for (i = 0; i < 30; i++)
+		ok = ok && out[i] == &data[20 + i];
+	TEST_ASSERT(ok);
+
+	/* Empty ring */
+	TEST_ASSERT(ring_dequeue_n(r, out, 64) == 0);
+	TEST_ASSERT(ring_destroy(r) == 0);
+}
+
+/* THROUGHPUT COMPARISON START */
+#define BENCH_ITEMS	1000000
+#define BENCH_DEPTH	1024
+#define BENCH_BATCH	64
+
+static double now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void *bench_items[BENCH_DEPTH];
+
+/**
+ * @brief Moves BENCH_ITEMS items through a list queue holding BENCH_DEPTH items
+ * @return Returns the cost of one enqueue/dequeue pair, in ns
+ */
+static double bench_queue(void)
+{
+	queue_t q = queue_create();
+	void *ptr;
+	double start;
+	int i;
+
+	for (i = 0; i < BENCH_DEPTH; i++)
+		queue_enqueue(q, bench_items[i]);
+
+	start = now_ns();
+	for (i = 0; i < BENCH_ITEMS; i++)
+	{
+		queue_dequeue(q, &ptr);
+		queue_enqueue(q, ptr);
+	}
+	start = now_ns() - start;
+
+	while (queue_dequeue(q, &ptr) == 0) {}
+	queue_destroy(q);
+	return start / BENCH_ITEMS;
+}
+
+/**
+ * @brief Same as bench_queue(), with a ring buffer queue
+ * @return Returns the cost of one enqueue/dequeue pair, in ns
+ */
+static double bench_ring(void)
+{
+	ring_t r = ring_create();
+	void *ptr;
+	double start;
+	int i;
+
+	ring_enqueue_n(r, bench_items, BENCH_DEPTH);
+
+	start = now_ns();
+	for (i = 0; i < BENCH_ITEMS; i++)
+	{
+		ring_dequeue(r, &ptr);
+		ring_enqueue(r, ptr);
+	}
+	start = now_ns() - start;
+
+	ring_dequeue_n(r, bench_items, BENCH_DEPTH);
+	ring_destroy(r);
+	return start / BENCH_ITEMS;
+}
+
+/**
+ * @brief Same as bench_ring(), moving BENCH_BATCH items per call
+ * @return Returns the cost of one enqueue/dequeue pair, in ns
+ */
+static double bench_ring_bulk(void)
+{
+	ring_t r = ring_create();
+	void *batch[BENCH_BATCH];
+	double start;
+	int i;
+
+	ring_enqueue_n(r, bench_items, BENCH_DEPTH);
+
+	start = now_ns();
+	for (i = 0; i < BENCH_ITEMS; i += BENCH_BATCH)
+	{
+		ring_dequeue_n(r, batch, BENCH_BATCH);
+		ring_enqueue_n(r, batch, BENCH_BATCH);
+	}
+	start = now_ns() - start;
+
+	ring_dequeue_n(r, bench_items, BENCH_DEPTH);
+	ring_destroy(r);
+	return start / BENCH_ITEMS;
+}
+
+/**
+ * @brief Compares the throughput of queue_t and ring_t
+ */
+void bench_throughput(void)
+{
+	static int data[BENCH_DEPTH];
+	int i;
+
+	for (i = 0; i < BENCH_DEPTH; i++)
+		bench_items[i] = &data[i];
+
+	printf("THROUGHPUT: %d items, %d queued\n", BENCH_ITEMS, BENCH_DEPTH);
+	printf("queue_t ........... %6.1f ns/item\n", bench_queue());
+	printf("ring_t ............ %6.1f ns/item\n", bench_ring());
+	printf("ring_t (bulk %d) .. %6.1f ns/item\n", BENCH_BATCH,
+	       bench_ring_bulk());
+}
+/* THROUGHPUT COMPARISON END */
+
 int main(void)
 {
 	test_create();
@@ -283,6 +501,11 @@ int main(void)
 	test_queue_length();
 	test_enqueue();
 	test_delete();
+	test_ring_simple();
+	test_ring_errors();
+	test_ring_bulk();
+
+	bench_throughput();
 
 	return 0;
 }
@@ -0,0 +1,163 @@
+/*
+ * Deadline scheduling test
+ *
+ * Runs two periodic threads for half a second next to BATCH CPU-bound threads,
+ * with preemption enabled (1 ms slices):
+ * - a heartbeat, every 5 ms, computing for 200 us with a 2 ms deadline;
+ * - a telemetry flush, every 20 ms, computing for 1 ms with a 10 ms deadline.
+ *
+ * As plain threads, the periodic threads yield until their next period, and
+ * wait for every batch thread to run a whole slice each time, so they miss
+ * most of their deadlines (periods that go by entirely count as missed). In
+ * the deadline class, their jobs are released by the preemption timer, and run
+ * ahead of the batch threads: they should miss none.
+ *
+ * Output (numbers vary):
+ * class      jobs  missed
+ * rr            7     163
+ * edf         125       0
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <uthread.h>
+
+#define BATCH 200
+
+/* Wall-clock time each test runs for (in us) */
+#define RUN_US 500000
+
+struct periodic {
+	unsigned long period_us;
+	unsigned long deadline_us;
+	unsigned long work_us;
+};
+
+static const struct periodic tasks[] = {
+	{ 5000, 2000, 200 },
+	{ 20000, 10000, 1000 },
+};
+#define NTASKS (sizeof(tasks) / sizeof(tasks[0]))
+
+static bool edf;
+static double end;
+static volatile int running;
+static unsigned long jobs, missed;
+
+static double now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void spin_until(double until)
+{
+	while (now_us() < until)
+		;
+}
+
+static void periodic(void *arg)
+{
+	const struct periodic *task = arg;
+	double release = now_us();
+
+	while (now_us() < end) {
+		spin_until(now_us() + task->work_us);
+		jobs++;
+
+		if (edf) {
+			if (uthread_wait_period() < 0) {
+				printf("uthread_wait_period failed\n");
+				exit(1);
+			}
+		} else {
+			/* Skip the periods that went by, like the deadline class */
+			if (now_us() > release + task->deadline_us)
+				missed++;
+			release += task->period_us;
+			while (release + task->deadline_us < now_us()) {
+				release += task->period_us;
+				missed++;
+			}
+			while (now_us() < release)
+				uthread_yield();
+		}
+	}
+
+	if (edf)
+		missed = uthread_deadline_misses();
+	running--;
+}
+
+static void batch(void *arg)
+{
+	(void)arg;
+
+	while (running)
+		;
+}
+
+static void start(void *arg)
+{
+	uthread_attr_t attr;
+	(void)arg;
+
+	uthread_attr_init(&attr);
+	for (size_t i = 0; i < NTASKS; i++) {
+		if (edf) {
+			attr.period_us = tasks[i].period_us;
+			attr.deadline_us = tasks[i].deadline_us;
+		}
+		if (uthread_create_attr(periodic, (void *)&tasks[i], &attr) < 0) {
+			printf("uthread_create_attr failed\n");
+			exit(1);
+		}
+	}
+
+	for (int i = 0; i < BATCH; i++)
+		uthread_create(batch, NULL);
+}
+
+static void run(bool deadline)
+{
+	edf = deadline;
+	running = NTASKS;
+	jobs = missed = 0;
+	end = now_us() + RUN_US;
+	uthread_run(true, start, NULL);
+
+	printf("%-6s %8lu %7lu\n", edf ? "edf" : "rr", jobs, missed);
+}
+
+static void check_attr(void *arg)
+{
+	uthread_attr_t attr;
+	(void)arg;
+
+	/* Deadline after the period, and not a thread of the deadline class */
+	uthread_attr_init(&attr);
+	attr.period_us = 1000;
+	attr.deadline_us = 2000;
+	if (uthread_create_attr(check_attr, NULL, &attr) != -1 ||
+	    uthread_wait_period() != -1) {
+		printf("invalid deadline accepted\n");
+		exit(1);
+	}
+}
+
+int main(void)
+{
+	uthread_run(false, check_attr, NULL);
+
+	uthread_set_preemption(1000, UTHREAD_CLOCK_MONOTONIC);
+	printf("%-6s %8s %7s\n", "class", "jobs", "missed");
+	run(false);
+	run(true);
+
+	return 0;
+}
@@ -0,0 +1,137 @@
+/*
+ * Fair share scheduling test
+ *
+ * Runs CPU-bound threads for half a second with preemption enabled (1 ms
+ * slices), and prints the share of the computation each one got:
+ * - a "yielder" that yields every 100 us next to a "hog" that never yields:
+ *   round-robin gives both the same number of turns, so the hog gets about 10
+ *   times more CPU, while the fair policy splits the CPU evenly;
+ * - two tenants of weight 1024 and 3072, which the fair policy runs 25% and
+ *   75% of the time.
+ *
+ * Output (numbers vary):
+ * policy     yielder    hog
+ * rr           10.1%  89.9%
+ * fair         50.7%  49.3%
+ * weights       1024   3072
+ * fair         25.3%  74.7%
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <uthread.h>
+
+/* Wall-clock time each test runs for (in ms) */
+#define RUN_MS 500
+
+/* Time the yielder computes between yields (in us) */
+#define YIELD_US 100
+
+static double deadline;
+static unsigned long work[2];
+static volatile unsigned long sink;
+
+static double now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+/* Compute until @until, counting the work done in @count */
+static void compute(unsigned long *count, double until)
+{
+	unsigned long x = *count;
+
+	while (now_us() < until) {
+		for (int i = 0; i < 100; i++)
+			x = x * 6364136223846793005UL + 1442695040888963407UL;
+		(*count)++;
+	}
+	sink = x;
+}
+
+static void yielder(void *arg)
+{
+	(void)arg;
+
+	while (now_us() < deadline) {
+		compute(&work[0], now_us() + YIELD_US);
+		uthread_yield();
+	}
+}
+
+static void hog(void *arg)
+{
+	(void)arg;
+
+	compute(&work[1], deadline);
+}
+
+static void yielder_vs_hog(void *arg)
+{
+	(void)arg;
+
+	uthread_create(yielder, NULL);
+	uthread_create(hog, NULL);
+}
+
+static void tenant(void *arg)
+{
+	compute(&work[(long)arg], deadline);
+}
+
+static void tenants(void *arg)
+{
+	uthread_attr_t attr;
+	(void)arg;
+
+	uthread_attr_init(&attr);
+	attr.weight = 1024;
+	uthread_create_attr(tenant, (void *)0L, &attr);
+	attr.weight = 3072;
+	uthread_create_attr(tenant, (void *)1L, &attr);
+}
+
+static void run(const char *name, uthread_sched_t policy, uthread_func_t func)
+{
+	double total;
+
+	uthread_set_sched(policy);
+	work[0] = work[1] = 0;
+	deadline = now_us() + RUN_MS * 1000;
+	if (uthread_run(true, func, NULL)) {
+		printf("uthread_run failed\n");
+		exit(1);
+	}
+
+	total = work[0] + work[1];
+	printf("%-8s %8.1f%% %5.1f%%\n", name, work[0] * 100 / total,
+	       work[1] * 100 / total);
+}
+
+int main(void)
+{
+	uthread_attr_t attr;
+
+	/* Invalid weights */
+	uthread_attr_init(&attr);
+	attr.weight = 0;
+	if (uthread_create_attr(yielder, NULL, &attr) != -1) {
+		printf("invalid weight accepted\n");
+		exit(1);
+	}
+
+	uthread_set_preemption(1000, UTHREAD_CLOCK_MONOTONIC);
+	printf("%-8s %9s %6s\n", "policy", "yielder", "hog");
+	run("rr", UTHREAD_SCHED_RR, yielder_vs_hog);
+	run("fair", UTHREAD_SCHED_FAIR, yielder_vs_hog);
+	printf("%-8s %9s %6s\n", "weights", "1024", "3072");
+	run("fair", UTHREAD_SCHED_FAIR, tenants);
+
+	return 0;
+}
@@ -0,0 +1,152 @@
+/*
+ * Priority scheduling test
+ *
+ * First, without preemption, the main thread creates a low priority thread,
+ * then a high priority one. The high priority thread runs as soon as it is
+ * created, the low priority one only once the main thread is done.
+ *
+ * Then a "request handler" thread runs next to HOGS threads that compute
+ * without ever yielding, with preemption enabled (1 ms slices), for half a
+ * second. The handler yields between requests, and measures how long it waits
+ * to get the CPU back:
+ * - with round-robin, every hog runs a whole slice in between;
+ * - with a higher priority, the handler gets the CPU back right away;
+ * - with MLFQ, all the threads have the same priority, but the hogs quickly
+ *   get demoted for using up their slices, and only get in the handler's way
+ *   for a few slices after each periodic boost.
+ *
+ * Output (numbers vary):
+ * high
+ * main
+ * low
+ * policy       wait_us
+ * rr            4007.2
+ * priority         0.1
+ * mlfq             5.9
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <uthread.h>
+
+#define HOGS 4
+
+/* Wall-clock time each policy runs for (in ms) */
+#define RUN_MS 500
+
+/* Computation of each request */
+#define REQUEST_WORK 20000
+
+static uthread_attr_t handlerAttr;
+static volatile bool done;
+static double waited;
+static unsigned long requests;
+static volatile unsigned long sink;
+
+static double now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void say(void *arg)
+{
+	printf("%s\n", (char *)arg);
+}
+
+static void order(void *arg)
+{
+	uthread_attr_t attr;
+	(void)arg;
+
+	uthread_attr_init(&attr);
+	attr.priority = UTHREAD_PRIO_MIN;
+	uthread_create_attr(say, "low", &attr);
+	attr.priority = UTHREAD_PRIO_MAX;
+	uthread_create_attr(say, "high", &attr);
+	say("main");
+}
+
+static void hog(void *arg)
+{
+	unsigned long x = 1;
+
+	if (arg && uthread_set_priority(UTHREAD_PRIO_MIN)) {
+		printf("uthread_set_priority failed\n");
+		exit(1);
+	}
+
+	while (!done)
+		x = x * 6364136223846793005UL + 1442695040888963407UL;
+	sink = x;
+}
+
+static void handler(void *arg)
+{
+	double deadline = now_us() + RUN_MS * 1000;
+	(void)arg;
+
+	for (requests = 0; now_us() < deadline; requests++) {
+		unsigned long x = requests;
+		double start;
+
+		for (int j = 0; j < REQUEST_WORK; j++)
+			x = x * 6364136223846793005UL + 1442695040888963407UL;
+		sink = x;
+
+		start = now_us();
+		uthread_yield();
+		waited += now_us() - start;
+	}
+	done = true;
+}
+
+static void start(void *arg)
+{
+	for (int i = 0; i < HOGS; i++)
+		uthread_create(hog, arg);
+	uthread_create_attr(handler, NULL, &handlerAttr);
+}
+
+static void run(const char *name, uthread_sched_t policy, bool priority)
+{
+	uthread_set_sched(policy);
+	uthread_attr_init(&handlerAttr);
+	if (priority)
+		handlerAttr.priority = UTHREAD_PRIO_MAX;
+
+	done = false;
+	waited = 0;
+	uthread_run(true, start, priority ? (void *)1L : NULL);
+	printf("%-10s %9.1f\n", name, waited / requests);
+}
+
+int main(void)
+{
+	uthread_attr_t attr;
+
+	/* Invalid configurations */
+	uthread_attr_init(&attr);
+	attr.priority = UTHREAD_PRIO_MAX + 1;
+	if (uthread_set_sched((uthread_sched_t)42) != -1 ||
+	    uthread_set_priority(UTHREAD_PRIO_MIN) != -1 ||
+	    uthread_create_attr(say, NULL, &attr) != -1) {
+		printf("invalid configuration accepted\n");
+		exit(1);
+	}
+
+	uthread_run(false, order, NULL);
+
+	uthread_set_preemption(1000, UTHREAD_CLOCK_MONOTONIC);
+	printf("%-10s %9s\n", "policy", "wait_us");
+	run("rr", UTHREAD_SCHED_RR, false);
+	run("priority", UTHREAD_SCHED_RR, true);
+	run("mlfq", UTHREAD_SCHED_MLFQ, false);
+
+	return 0;
+}
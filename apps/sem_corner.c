@@ -1,6 +1,12 @@
 /*
  * Phase 2 semaphore corner case
  *
+ * threadA blocks on sem1, threadB releases it and threadC tries to take it
+ * before threadA gets to run again. The resource is handed to threadA, the
+ * oldest waiter, so threadC is the one left blocked. The program should output:
+ *
+ * B
+ * A
  */
 
 #include <stdbool.h>
@@ -0,0 +1,94 @@
+/*
+ * Thread spawning benchmark
+ *
+ * Measures the cost of a short-lived thread, as in a thread-per-request server:
+ * the main thread creates a number of threads (1000000 by default, or the first
+ * argument) in waves of WAVE, yielding after each wave so that they run. Every
+ * thread is detached, and only counts itself before exiting, so the time per
+ * thread is that of its creation, its first switch in and its exit.
+ *
+ * Output (numbers vary):
+ * threads     ns/thread
+ * 1000000         289.8
+ */
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <uthread.h>
+
+#define THREADS 1000000
+
+/* Small enough for the stacks of a wave to stay in the stack cache */
+#define WAVE 32
+
+static unsigned long threads = THREADS;
+static unsigned long ran;
+
+static double now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void request(void *arg)
+{
+	(void)arg;
+
+	ran++;
+}
+
+static void spawner(void *arg)
+{
+	(void)arg;
+
+	for (unsigned long i = 0; i < threads; i++) {
+		uthread_tid_t tid = uthread_create(request, NULL);
+
+		/* Nobody waits for the requests, let them go as soon as they exit */
+		if (tid < 0 || uthread_detach(tid)) {
+			printf("uthread_create failed\n");
+			exit(1);
+		}
+		if (i % WAVE == WAVE - 1)
+			uthread_yield();
+	}
+}
+
+static unsigned long get_argv(char *argv)
+{
+	long int ret = strtol(argv, NULL, 0);
+
+	if (ret == LONG_MIN || ret == LONG_MAX || ret <= 0) {
+		perror("strtol");
+		exit(1);
+	}
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	double start, end;
+
+	if (argc > 1)
+		threads = get_argv(argv[1]);
+
+	start = now_ns();
+	uthread_run(false, spawner, NULL);
+	end = now_ns();
+
+	if (ran != threads) {
+		printf("%lu threads ran out of %lu\n", ran, threads);
+		exit(1);
+	}
+
+	printf("%-10s %10s\n", "threads", "ns/thread");
+	printf("%-10lu %10.1f\n", threads, (end - start) / threads);
+
+	return 0;
+}
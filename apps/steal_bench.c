@@ -0,0 +1,110 @@
+/*
+ * Work-stealing scalability benchmark
+ *
+ * Runs a tree of fine-grained tasks on 1 to 64 workers (or up to the first
+ * argument). Every task spawns two children until the tree is DEPTH levels
+ * deep, and the leaves do a little computation. Children start on the deque of
+ * their parent's worker, and idle workers steal them from there, so the
+ * throughput should grow with the number of workers up to the number of CPUs.
+ *
+ * A single worker runs the tasks in FIFO order instead, breadth first, so it
+ * has many more tasks alive at once.
+ *
+ * Output (numbers vary):
+ * workers      tasks          ms   tasks/ms
+ *       1      65535       689.4       95.1
+ *       2      65535       103.3      634.4
+ *       4      65535       125.2      523.4
+ * ...
+ */
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <uthread.h>
+
+#define DEPTH 16
+#define LEAF_WORK 200
+#define MAX_WORKERS 64
+
+static uthread_attr_t attr;
+static unsigned long tasks;
+static volatile unsigned long sink;
+
+static double now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static void task(void *arg)
+{
+	uintptr_t depth = (uintptr_t)arg;
+
+	__atomic_add_fetch(&tasks, 1, __ATOMIC_RELAXED);
+
+	if (depth > 1) {
+		if (uthread_create_attr(task, (void *)(depth - 1), &attr) < 0 ||
+		    uthread_create_attr(task, (void *)(depth - 1), &attr) < 0) {
+			printf("uthread_create failed\n");
+			exit(1);
+		}
+		return;
+	}
+
+	unsigned long x = depth;
+	for (int i = 0; i < LEAF_WORK; i++)
+		x = x * 6364136223846793005UL + 1442695040888963407UL;
+	sink = x;
+}
+
+static size_t get_argv(char *argv)
+{
+	long int ret = strtol(argv, NULL, 0);
+
+	if (ret == LONG_MIN || ret == LONG_MAX || ret <= 0) {
+		perror("strtol");
+		exit(1);
+	}
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	size_t maxWorkers = MAX_WORKERS;
+
+	if (argc > 1)
+		maxWorkers = get_argv(argv[1]);
+
+	/* Small unguarded stacks, tasks are short-lived and shallow */
+	uthread_attr_init(&attr);
+	attr.stack_size = 16384;
+	attr.guard_size = 0;
+
+	printf("%7s %10s %11s %10s\n", "workers", "tasks", "ms", "tasks/ms");
+	for (size_t n = 1; n <= maxWorkers; n *= 2) {
+		double start, ms;
+
+		tasks = 0;
+		start = now_ms();
+		if (uthread_run_workers(n, false, task, (void *)DEPTH)) {
+			printf("uthread_run_workers failed\n");
+			exit(1);
+		}
+		ms = now_ms() - start;
+
+		printf("%7zu %10lu %11.1f %10.1f\n", n, tasks, ms, tasks / ms);
+		if (tasks != (1UL << DEPTH) - 1) {
+			printf("tasks should be %lu\n", (1UL << DEPTH) - 1);
+			exit(1);
+		}
+	}
+
+	return 0;
+}
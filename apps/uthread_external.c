@@ -0,0 +1,118 @@
+/*
+ * External wakeups test
+ *
+ * PRODUCERS plain pthreads, standing for the threads of a third-party library,
+ * hand work to the threads: each one releases a semaphore MESSAGES times with
+ * sem_up_external(), which a consumer thread takes as many times, and creates
+ * SPAWNS threads with uthread_create_external(). The main thread holds the run
+ * with uthread_external_hold() while the producers start, each producer holds
+ * it until it is done, and the run ends once everything was carried out. The
+ * time per message is that of the producers posting to the inbox and the
+ * worker draining it in batches.
+ *
+ * Output (numbers vary):
+ * semaphore released 400000 times
+ * 400 threads created
+ * 164.0 ns/message
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <sem.h>
+#include <uthread.h>
+
+#define PRODUCERS 4
+#define MESSAGES 100000
+#define SPAWNS 100
+
+static sem_t work;
+static unsigned long taken, spawned;
+
+static double now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void spawnee(void *arg)
+{
+	(void)arg;
+
+	spawned++;
+}
+
+static void *producer(void *arg)
+{
+	(void)arg;
+
+	for (int i = 0; i < MESSAGES; i++) {
+		if (sem_up_external(work)) {
+			printf("sem_up_external failed\n");
+			exit(1);
+		}
+		if (i % (MESSAGES / SPAWNS) == 0 &&
+		    uthread_create_external(spawnee, NULL)) {
+			printf("uthread_create_external failed\n");
+			exit(1);
+		}
+	}
+
+	uthread_external_release();
+	return NULL;
+}
+
+static void consumer(void *arg)
+{
+	(void)arg;
+
+	for (int i = 0; i < PRODUCERS * MESSAGES; i++) {
+		sem_down(work);
+		taken++;
+	}
+}
+
+static void start(void *arg)
+{
+	pthread_t *producers = arg;
+
+	uthread_create(consumer, NULL);
+
+	for (int i = 0; i < PRODUCERS; i++) {
+		uthread_external_hold();
+		if (pthread_create(&producers[i], NULL, producer, NULL)) {
+			printf("pthread_create failed\n");
+			exit(1);
+		}
+	}
+
+	/* The producers hold the run for themselves from now on */
+	uthread_external_release();
+}
+
+int main(void)
+{
+	pthread_t producers[PRODUCERS];
+	double elapsed;
+
+	work = sem_create(0);
+
+	elapsed = now_ns();
+	uthread_external_hold();
+	uthread_run(false, start, producers);
+	elapsed = now_ns() - elapsed;
+
+	for (int i = 0; i < PRODUCERS; i++)
+		pthread_join(producers[i], NULL);
+	sem_destroy(work);
+
+	printf("semaphore released %lu times\n", taken);
+	printf("%lu threads created\n", spawned);
+	printf("%.1f ns/message\n", elapsed / (PRODUCERS * (MESSAGES + SPAWNS)));
+
+	return 0;
+}
@@ -0,0 +1,142 @@
+/*
+ * Thread joining test
+ *
+ * The main thread joins a thread that is still running, which blocks it until
+ * the thread exits with its return value, then a thread that already exited.
+ * Joining or detaching threads that cannot be (the caller itself, a thread that
+ * was already joined, detached or is being joined) fails, and so does joining
+ * a detached thread that exited, which is already gone.
+ *
+ * Then, with four workers, the main thread creates JOINED threads that all
+ * return a different value, and joins them to add those values up.
+ *
+ * The program should output:
+ *
+ * thread1 returned 42
+ * thread2 returned 0
+ * 1000 threads joined, sum 999000
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <uthread.h>
+
+#define JOINED 1000
+
+static uthread_tid_t waiting;
+
+static void check(bool ok, const char *what)
+{
+	if (!ok) {
+		printf("%s\n", what);
+		exit(1);
+	}
+}
+
+static void thread1(void *arg)
+{
+	(void)arg;
+
+	uthread_yield();
+	uthread_exit((void *)42);
+}
+
+static void thread2(void *arg)
+{
+	(void)arg;
+}
+
+/* Joins the thread the main thread then tries to join too */
+static void joiner(void *arg)
+{
+	(void)arg;
+
+	check(uthread_join(waiting, NULL) == 0, "uthread_join failed");
+}
+
+static void waiter(void *arg)
+{
+	(void)arg;
+
+	uthread_yield();
+	uthread_yield();
+}
+
+static void order(void *arg)
+{
+	uthread_tid_t tid;
+	void *retval;
+	(void)arg;
+
+	/* Still running */
+	tid = uthread_create(thread1, NULL);
+	check(tid > 0, "uthread_create failed");
+	check(uthread_join(tid, &retval) == 0, "uthread_join failed");
+	printf("thread1 returned %ld\n", (long)retval);
+	check(uthread_join(tid, NULL) == -1, "joined a thread twice");
+
+	/* Already exited */
+	tid = uthread_create(thread2, NULL);
+	uthread_yield();
+	retval = (void *)1;
+	check(uthread_join(tid, &retval) == 0, "uthread_join failed");
+	printf("thread2 returned %ld\n", (long)retval);
+
+	/* Detached, then gone once it exits */
+	tid = uthread_create(thread2, NULL);
+	check(uthread_detach(tid) == 0, "uthread_detach failed");
+	check(uthread_detach(tid) == -1, "detached a thread twice");
+	check(uthread_join(tid, NULL) == -1, "joined a detached thread");
+	uthread_yield();
+	check(uthread_detach(tid) == -1, "detached an exited thread");
+
+	/* Being joined by another thread */
+	waiting = uthread_create(waiter, NULL);
+	tid = uthread_create(joiner, NULL);
+	uthread_yield();
+	check(uthread_join(waiting, NULL) == -1, "joined a thread being joined");
+	check(uthread_detach(waiting) == -1, "detached a thread being joined");
+	check(uthread_join(tid, NULL) == 0, "uthread_join failed");
+
+	check(uthread_join(uthread_self(), NULL) == -1, "joined itself");
+	check(uthread_join(0, NULL) == -1, "joined an invalid thread");
+}
+
+static void value(void *arg)
+{
+	uthread_yield();
+	uthread_exit((void *)(2 * (uintptr_t)arg));
+}
+
+static void sum(void *arg)
+{
+	uthread_tid_t tids[JOINED];
+	uintptr_t total = 0;
+	(void)arg;
+
+	for (uintptr_t i = 0; i < JOINED; i++) {
+		tids[i] = uthread_create(value, (void *)i);
+		check(tids[i] > 0, "uthread_create failed");
+	}
+
+	for (int i = 0; i < JOINED; i++) {
+		void *retval;
+
+		check(uthread_join(tids[i], &retval) == 0, "uthread_join failed");
+		total += (uintptr_t)retval;
+	}
+
+	printf("%d threads joined, sum %lu\n", JOINED, (unsigned long)total);
+}
+
+int main(void)
+{
+	check(uthread_join(1, NULL) == -1, "joined outside of a thread");
+	uthread_run(false, order, NULL);
+	uthread_run_workers(4, true, sum, NULL);
+
+	return 0;
+}
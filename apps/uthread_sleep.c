@@ -0,0 +1,205 @@
+/*
+ * Sleeping test
+ *
+ * First, three threads sleep for 30, 10 and 20 ms, and wake up in order of
+ * their deadlines. Sleeping until a time already past returns right away.
+ *
+ * Then the main thread sleeps for 200 ms on four workers, with nothing else to
+ * run: the idle workers block in the kernel until it wakes up instead of
+ * spinning, so the process uses next to no CPU time.
+ *
+ * Last, for 1000, 10000, ... up to a number of threads (100000 by default, or
+ * the first argument), all the threads sleep at once, twice each, until a
+ * random time within a second. Arming and expiring their timers is O(1), so the
+ * CPU time per sleep does not grow with the number of sleeping threads; it
+ * shrinks, as a worker that wakes up finds more threads to run. A sleep ends up
+ * to a tick (about 131 us) late, more when many threads wake up at once.
+ *
+ * Output (numbers vary):
+ * thread2
+ * thread3
+ * thread1
+ * slept 200 ms using 0.7 ms of CPU
+ * sleepers    late_us  max_late_us  cpu_ns/sleep
+ * 1000          160.6       2793.6       24133.0
+ * 10000         157.5       8266.4        8125.4
+ * 100000       1010.1      88411.1        3114.2
+ */
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <sem.h>
+#include <uthread.h>
+
+#define SLEEPERS 100000
+
+/*
+ * Once all the sleepers are started, each one sleeps ROUNDS times, until a
+ * random time within ROUND_NS of its previous deadline
+ */
+#define ROUNDS 2
+#define ROUND_NS 1000000000ULL
+
+static unsigned long maxSleepers = SLEEPERS;
+static unsigned long sleepers, started, woken;
+static uint64_t cpu;
+static sem_t go;
+static double late, maxLate;
+
+static uint64_t now_ns(clockid_t clock)
+{
+	struct timespec ts;
+
+	clock_gettime(clock, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void check(bool ok, const char *what)
+{
+	if (!ok) {
+		printf("%s\n", what);
+		exit(1);
+	}
+}
+
+static const long delays_ms[] = { 30, 10, 20 };
+
+static void thread(void *arg)
+{
+	check(uthread_sleep_ns(delays_ms[(long)arg] * 1000000) == 0,
+	      "uthread_sleep_ns failed");
+	printf("thread%ld\n", (long)arg + 1);
+}
+
+static void order(void *arg)
+{
+	(void)arg;
+
+	for (long i = 0; i < 3; i++)
+		uthread_create(thread, (void *)i);
+
+	check(uthread_sleep_until(0) == 0 && uthread_sleep_ns(0) == 0,
+	      "uthread_sleep_until failed");
+}
+
+static void idle(void *arg)
+{
+	(void)arg;
+
+	uthread_sleep_ns(200000000);
+}
+
+static void sleeper(void *arg)
+{
+	uint64_t deadline;
+	(void)arg;
+
+	/*
+	 * Only time the sleeps, not the creation of the threads nor their first
+	 * run, which faults their stack in
+	 */
+	if (++started == sleepers) {
+		cpu = now_ns(CLOCK_PROCESS_CPUTIME_ID);
+		for (unsigned long i = 1; i < sleepers; i++)
+			sem_up(go);
+	} else {
+		sem_down(go);
+	}
+
+	deadline = now_ns(CLOCK_MONOTONIC);
+
+	for (int i = 0; i < ROUNDS; i++) {
+		double ns;
+
+		deadline += (uint64_t)rand() * ROUND_NS / RAND_MAX;
+		uthread_sleep_until(deadline);
+		ns = now_ns(CLOCK_MONOTONIC) - deadline;
+		late += ns;
+		if (ns > maxLate)
+			maxLate = ns;
+	}
+
+	/* Nor their exit */
+	if (++woken == sleepers) {
+		cpu = now_ns(CLOCK_PROCESS_CPUTIME_ID) - cpu;
+		for (unsigned long i = 1; i < sleepers; i++)
+			sem_up(go);
+	} else {
+		sem_down(go);
+	}
+}
+
+static void spawner(void *arg)
+{
+	uthread_attr_t attr;
+	(void)arg;
+
+	/* Small unguarded stacks, so that 100k threads fit in the mapping limit */
+	uthread_attr_init(&attr);
+	attr.stack_size = 16384;
+	attr.guard_size = 0;
+
+	for (unsigned long i = 0; i < sleepers; i++) {
+		uthread_tid_t tid = uthread_create_attr(sleeper, NULL, &attr);
+
+		if (tid < 0 || uthread_detach(tid)) {
+			printf("uthread_create failed after %lu threads\n", i);
+			exit(1);
+		}
+	}
+}
+
+static void run(unsigned long count)
+{
+	sleepers = count;
+	started = woken = 0;
+	late = maxLate = 0;
+
+	go = sem_create(0);
+	uthread_run(false, spawner, NULL);
+	sem_destroy(go);
+
+	printf("%-10lu %8.1f %12.1f %13.1f\n", sleepers,
+	       late / (sleepers * ROUNDS) / 1e3, maxLate / 1e3,
+	       (double)cpu / (sleepers * ROUNDS));
+}
+
+static unsigned long get_argv(char *argv)
+{
+	long int ret = strtol(argv, NULL, 0);
+
+	if (ret == LONG_MIN || ret == LONG_MAX || ret <= 0) {
+		perror("strtol");
+		exit(1);
+	}
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	uint64_t start;
+
+	if (argc > 1)
+		maxSleepers = get_argv(argv[1]);
+
+	check(uthread_sleep_ns(1) == -1, "slept outside of a thread");
+	uthread_run(false, order, NULL);
+
+	start = now_ns(CLOCK_PROCESS_CPUTIME_ID);
+	uthread_run_workers(4, false, idle, NULL);
+	printf("slept 200 ms using %.1f ms of CPU\n",
+	       (now_ns(CLOCK_PROCESS_CPUTIME_ID) - start) / 1e6);
+
+	printf("%-10s %8s %12s %13s\n", "sleepers", "late_us", "max_late_us",
+	       "cpu_ns/sleep");
+	for (unsigned long count = 1000; count < maxSleepers; count *= 10)
+		run(count);
+	run(maxSleepers);
+
+	return 0;
+}
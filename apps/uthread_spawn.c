@@ -0,0 +1,76 @@
+/*
+ * Thread spawning test
+ *
+ * Tests that stacks are recycled correctly when short-lived threads are
+ * created at a high rate. The main thread spawns waves of workers, each of them
+ * writing all over its stack before exiting. The stack cache is kept small so
+ * that both warm and trimmed stacks get reused. The program should output:
+ *
+ * 10000 threads ran
+ */
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <uthread.h>
+
+#define THREADS 10000
+#define WAVE 100
+
+static unsigned int ran;
+
+static void worker(void *arg)
+{
+	char buf[8192];
+
+	/* Dirty the stack, and check it is our own */
+	memset(buf, (int)(size_t)arg, sizeof(buf));
+	uthread_yield();
+	for (size_t i = 0; i < sizeof(buf); i++) {
+		if (buf[i] != (char)(size_t)arg) {
+			printf("stack corrupted\n");
+			exit(1);
+		}
+	}
+	ran++;
+}
+
+static void spawner(void *arg)
+{
+	unsigned int max = *(unsigned int *)arg;
+
+	for (unsigned int i = 0; i < max; i++) {
+		uthread_create(worker, (void *)(size_t)(i & 0x7f));
+		if (i % WAVE == WAVE - 1)
+			uthread_yield();
+	}
+}
+
+static unsigned int get_argv(char *argv)
+{
+	long int ret = strtol(argv, NULL, 0);
+
+	if (ret == LONG_MIN || ret == LONG_MAX) {
+		perror("strtol");
+		exit(1);
+	}
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int max = THREADS;
+
+	if (argc > 1)
+		max = get_argv(argv[1]);
+
+	uthread_set_stack_cache(8);
+	uthread_run(false, spawner, &max);
+
+	printf("%u threads ran\n", ran);
+
+	return 0;
+}
@@ -0,0 +1,106 @@
+/*
+ * Per-thread stack test
+ *
+ * Tests threads created with specific stack sizes. A thread with a small stack
+ * and a thread with a large one each recurse as deep as their stack allows,
+ * then a thread recurses without bound and must hit the guard page below its
+ * stack. The program should output:
+ *
+ * small stack ok
+ * large stack ok
+ * stack overflow caught
+ */
+
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <uthread.h>
+
+/* Roughly 1 KiB of stack per level of recursion */
+static int recurse(int depth)
+{
+	volatile char buf[1024];
+
+	buf[0] = (char)depth;
+	if (depth == 0)
+		return buf[0];
+
+	return recurse(depth - 1) + buf[0];
+}
+
+static void small(void *arg)
+{
+	(void)arg;
+
+	recurse(4);
+	printf("small stack ok\n");
+}
+
+static void large(void *arg)
+{
+	(void)arg;
+
+	recurse(900);
+	printf("large stack ok\n");
+}
+
+static void overflow(void *arg)
+{
+	(void)arg;
+
+	recurse(1 << 30);
+	printf("stack overflow missed\n");
+	exit(1);
+}
+
+static void segv_handler(int signum)
+{
+	(void)signum;
+
+	/* Only async-signal-safe calls from here */
+	write(STDOUT_FILENO, "stack overflow caught\n", 22);
+	_exit(0);
+}
+
+static void thread1(void *arg)
+{
+	uthread_attr_t attr;
+	(void)arg;
+
+	uthread_attr_init(&attr);
+
+	attr.stack_size = 16384;
+	uthread_create_attr(small, NULL, &attr);
+
+	attr.stack_size = 1024 * 1024;
+	uthread_create_attr(large, NULL, &attr);
+
+	attr.stack_size = 16384;
+	uthread_create_attr(overflow, NULL, &attr);
+
+	/* Too small */
+	attr.stack_size = UTHREAD_STACK_MIN - 1;
+	if (uthread_create_attr(small, NULL, &attr) != -1)
+		printf("invalid stack size accepted\n");
+}
+
+int main(void)
+{
+	static char altstack[65536];
+	stack_t ss = { .ss_sp = altstack, .ss_size = sizeof(altstack) };
+	struct sigaction sa = { .sa_handler = segv_handler,
+				.sa_flags = SA_ONSTACK };
+
+	/* The faulting stack is unusable, handle the fault on another one */
+	sigaltstack(&ss, NULL);
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGSEGV, &sa, NULL);
+
+	setvbuf(stdout, NULL, _IONBF, 0);
+	uthread_run(false, thread1, NULL);
+
+	return 1;
+}
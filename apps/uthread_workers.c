@@ -0,0 +1,126 @@
+/*
+ * Multiple workers test
+ *
+ * Runs the same workload on a single worker, and then on several workers (one
+ * per CPU by default, or the first argument). The main thread spawns threads
+ * that each compute for a while, yielding now and then, and add up their work
+ * in a counter shared by all the threads and protected by a semaphore. The
+ * counter must be exact in both runs, and the run on several workers should be
+ * faster on a multi-core machine.
+ *
+ * Output (numbers vary):
+ * workers    counter          ms
+ *       1     256000       812.4
+ *       8     256000       109.7
+ */
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sem.h>
+#include <uthread.h>
+
+#define THREADS 256
+#define ROUNDS 1000
+#define WORK 20000
+
+static sem_t lock;
+static sem_t done;
+static unsigned long counter;
+static volatile unsigned long sink;
+
+static double now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static void worker(void *arg)
+{
+	unsigned long x = (unsigned long)arg;
+
+	for (int i = 0; i < ROUNDS; i++) {
+		/* Some private computation... */
+		for (int j = 0; j < WORK / ROUNDS; j++)
+			x = x * 6364136223846793005UL + 1442695040888963407UL;
+		sink = x;
+
+		/* ...and a shared update */
+		sem_down(lock);
+		counter++;
+		sem_up(lock);
+
+		if (i % 100 == 0)
+			uthread_yield();
+	}
+
+	sem_up(done);
+}
+
+static void spawner(void *arg)
+{
+	(void)arg;
+
+	for (unsigned long i = 0; i < THREADS; i++)
+		uthread_create(worker, (void *)i);
+
+	for (int i = 0; i < THREADS; i++)
+		sem_down(done);
+}
+
+static void run(size_t nworkers)
+{
+	double start;
+
+	counter = 0;
+	lock = sem_create(1);
+	done = sem_create(0);
+
+	start = now_ms();
+	if (uthread_run_workers(nworkers, false, spawner, NULL)) {
+		printf("uthread_run_workers failed\n");
+		exit(1);
+	}
+
+	printf("%7zu %10lu %11.1f\n", nworkers, counter, now_ms() - start);
+	if (counter != THREADS * ROUNDS) {
+		printf("counter should be %d\n", THREADS * ROUNDS);
+		exit(1);
+	}
+
+	sem_destroy(lock);
+	sem_destroy(done);
+}
+
+static size_t get_argv(char *argv)
+{
+	long int ret = strtol(argv, NULL, 0);
+
+	if (ret == LONG_MIN || ret == LONG_MAX || ret <= 0) {
+		perror("strtol");
+		exit(1);
+	}
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	size_t nworkers = argc > 1 ? get_argv(argv[1]) : 0;
+
+	if (nworkers == 0) {
+		long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		nworkers = cpus > 0 ? cpus : 1;
+	}
+
+	printf("%7s %10s %11s\n", "workers", "counter", "ms");
+	run(1);
+	run(nworkers);
+
+	return 0;
+}
@@ -0,0 +1,160 @@
+/*
+ * Directed yield test
+ *
+ * First, three threads record their identifier and yield back to the main
+ * thread, which then yields to them in reverse order, each one yielding back to
+ * it. Yielding to a thread that is not ready (the caller itself, an exited
+ * thread, an invalid identifier) fails.
+ *
+ * Then a client and a server pass a request back and forth ROUNDS times next to
+ * IDLE threads that keep yielding. With uthread_yield(), every request waits
+ * for all the idle threads to run; uthread_yield_to() goes straight to the
+ * other side.
+ *
+ * Output (numbers vary):
+ * thread3
+ * thread2
+ * thread1
+ * method           us/request
+ * uthread_yield         92.4
+ * uthread_yield_to       0.1
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <uthread.h>
+
+#define IDLE 1000
+#define ROUNDS 2000
+
+static uthread_tid_t mainTid, tids[3];
+static uthread_tid_t clientTid, serverTid;
+static volatile bool done;
+static bool directed;
+static unsigned long requests, replies;
+static double begin, end;
+
+static double now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static void check(bool ok, const char *what)
+{
+	if (!ok) {
+		printf("%s\n", what);
+		exit(1);
+	}
+}
+
+static void thread(void *arg)
+{
+	tids[(long)arg] = uthread_self();
+	uthread_yield();
+	printf("thread%ld\n", (long)arg + 1);
+	check(uthread_yield_to(mainTid) == 0, "uthread_yield_to failed");
+}
+
+static void order(void *arg)
+{
+	(void)arg;
+
+	mainTid = uthread_self();
+	for (long i = 0; i < 3; i++)
+		uthread_create(thread, (void *)i);
+	uthread_yield();
+
+	check(uthread_yield_to(uthread_self()) == -1, "yielded to itself");
+	check(uthread_yield_to(0) == -1, "yielded to an invalid thread");
+	for (int i = 2; i >= 0; i--)
+		check(uthread_yield_to(tids[i]) == 0, "uthread_yield_to failed");
+
+	/* Let them exit */
+	uthread_yield();
+	check(uthread_yield_to(tids[0]) == -1, "yielded to an exited thread");
+}
+
+/* Wait for the other side to take its turn */
+static void pass(uthread_tid_t other, unsigned long *mine,
+		 unsigned long *theirs)
+{
+	unsigned long count = ++*mine;
+
+	while (*theirs < count && !done) {
+		if (directed)
+			check(uthread_yield_to(other) == 0,
+			      "uthread_yield_to failed");
+		else
+			uthread_yield();
+	}
+}
+
+static void client(void *arg)
+{
+	(void)arg;
+
+	clientTid = uthread_self();
+	uthread_yield();
+	begin = now_us();
+	for (int i = 0; i < ROUNDS; i++)
+		pass(serverTid, &requests, &replies);
+	end = now_us();
+	done = true;
+}
+
+static void server(void *arg)
+{
+	(void)arg;
+
+	serverTid = uthread_self();
+	uthread_yield();
+	while (!done)
+		pass(clientTid, &replies, &requests);
+}
+
+static void idle(void *arg)
+{
+	(void)arg;
+
+	while (!done)
+		uthread_yield();
+}
+
+static void start(void *arg)
+{
+	(void)arg;
+
+	for (int i = 0; i < IDLE; i++)
+		uthread_create(idle, NULL);
+	uthread_create(client, NULL);
+	uthread_create(server, NULL);
+}
+
+static void run(const char *name, bool mode)
+{
+	directed = mode;
+	done = false;
+	requests = replies = 0;
+
+	uthread_run(false, start, NULL);
+	printf("%-16s %10.1f\n", name, (end - begin) / ROUNDS);
+}
+
+int main(void)
+{
+	check(uthread_self() == -1 && uthread_yield_to(1) == -1,
+	      "uthread_self outside of a thread");
+	uthread_run(false, order, NULL);
+
+	printf("%-16s %10s\n", "method", "us/request");
+	run("uthread_yield", false);
+	run("uthread_yield_to", true);
+
+	return 0;
+}
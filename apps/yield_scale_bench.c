@@ -0,0 +1,105 @@
+/*
+ * Yield scalability benchmark
+ *
+ * Measures the cost of uthread_yield() as the number of ready threads grows.
+ * For each thread count, every thread yields in a loop until a total number of
+ * yields (1000000 by default, or the first argument) has been reached. The
+ * cost per yield should not depend on the number of threads.
+ *
+ * Output (numbers vary):
+ * threads    ns/yield
+ *      10       260.3
+ *    1000       265.1
+ *  100000       301.7
+ */
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <uthread.h>
+
+#define YIELDS 1000000
+
+static unsigned long totalYields = YIELDS;
+static unsigned long threadYields;
+static unsigned long threads;
+static double start, end;
+
+static double now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void yielder(void *arg)
+{
+	(void)arg;
+
+	for (unsigned long i = 0; i < threadYields; i++)
+		uthread_yield();
+}
+
+static void spawner(void *arg)
+{
+	uthread_attr_t attr;
+	(void)arg;
+
+	/* Small unguarded stacks, so that 100k threads fit in the mapping limit */
+	uthread_attr_init(&attr);
+	attr.stack_size = 16384;
+	attr.guard_size = 0;
+
+	for (unsigned long i = 0; i < threads; i++) {
+		if (uthread_create_attr(yielder, NULL, &attr) < 0) {
+			printf("uthread_create failed after %lu threads\n", i);
+			exit(1);
+		}
+	}
+
+	/* Let every thread reach its loop before starting the clock */
+	uthread_yield();
+
+	start = now_ns();
+	yielder(NULL);
+	end = now_ns();
+}
+
+static unsigned long get_argv(char *argv)
+{
+	long int ret = strtol(argv, NULL, 0);
+
+	if (ret == LONG_MIN || ret == LONG_MAX || ret <= 0) {
+		perror("strtol");
+		exit(1);
+	}
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long counts[] = { 10, 1000, 100000 };
+
+	if (argc > 1)
+		totalYields = get_argv(argv[1]);
+
+	printf("%7s %11s\n", "threads", "ns/yield");
+	for (size_t i = 0; i < sizeof(counts) / sizeof(counts[0]); i++) {
+		threads = counts[i];
+		threadYields = totalYields / (threads + 1);
+		if (threadYields == 0)
+			threadYields = 1;
+
+		uthread_run(false, spawner, NULL);
+
+		/* The spawner's loop covers one round of every thread's yields */
+		printf("%7lu %11.1f\n", threads,
+		       (end - start) / (threadYields * (threads + 1)));
+	}
+
+	return 0;
+}
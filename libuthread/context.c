@@ -1,11 +1,119 @@
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
 #include "private.h"
+#include "spinlock.h"
 #include "uthread.h"
 
-/* Size of the stack for a thread (in bytes) */
-#define UTHREAD_STACK_SIZE 32768
+#ifdef UTHREAD_CTX_ASM
+/*
+ * uthread_ctx_switch() is written in assembly: it pushes the callee-saved
+ * registers on the current stack, saves the stack pointer in @prev, loads the
+ * stack pointer from @next and pops the registers that were saved there. The
+ * final `ret` resumes @next where it last called uthread_ctx_switch().
+ *
+ * A new context is given a fake frame whose return address is
+ * uthread_ctx_trampoline, which moves the saved @func and @arg into argument
+ * registers and calls uthread_ctx_bootstrap().
+ */
+#if defined(__x86_64__)
+__asm__(
+	".text\n"
+	".globl uthread_ctx_switch\n"
+	".type uthread_ctx_switch, @function\n"
+	"uthread_ctx_switch:\n"
+	"	pushq %rbp\n"
+	"	pushq %rbx\n"
+	"	pushq %r12\n"
+	"	pushq %r13\n"
+	"	pushq %r14\n"
+	"	pushq %r15\n"
+	"	movq %rsp, (%rdi)\n"
+	"	movq (%rsi), %rsp\n"
+	"	popq %r15\n"
+	"	popq %r14\n"
+	"	popq %r13\n"
+	"	popq %r12\n"
+	"	popq %rbx\n"
+	"	popq %rbp\n"
+	"	ret\n"
+	".size uthread_ctx_switch, .-uthread_ctx_switch\n"
+	"\n"
+	".type uthread_ctx_trampoline, @function\n"
+	"uthread_ctx_trampoline:\n"
+	"	movq %r12, %rdi\n"
+	"	movq %r13, %rsi\n"
+	"	callq *%r14\n"
+	"	ud2\n"
+	".size uthread_ctx_trampoline, .-uthread_ctx_trampoline\n"
+);
+
+/* Order in which uthread_ctx_switch() pops registers from a saved stack */
+enum { FRAME_R15, FRAME_R14, FRAME_R13, FRAME_R12, FRAME_RBX, FRAME_RBP,
+       FRAME_RET, FRAME_WORDS };
+#define FRAME_FUNC	FRAME_R12
+#define FRAME_ARG	FRAME_R13
+#define FRAME_ENTRY	FRAME_R14
+
+#elif defined(__aarch64__)
+__asm__(
+	".text\n"
+	".globl uthread_ctx_switch\n"
+	".type uthread_ctx_switch, %function\n"
+	"uthread_ctx_switch:\n"
+	"	sub sp, sp, #0xa0\n"
+	"	stp x19, x20, [sp, #0x00]\n"
+	"	stp x21, x22, [sp, #0x10]\n"
+	"	stp x23, x24, [sp, #0x20]\n"
+	"	stp x25, x26, [sp, #0x30]\n"
+	"	stp x27, x28, [sp, #0x40]\n"
+	"	stp x29, x30, [sp, #0x50]\n"
+	"	stp d8, d9, [sp, #0x60]\n"
+	"	stp d10, d11, [sp, #0x70]\n"
+	"	stp d12, d13, [sp, #0x80]\n"
+	"	stp d14, d15, [sp, #0x90]\n"
+	"	mov x9, sp\n"
+	"	str x9, [x0]\n"
+	"	ldr x9, [x1]\n"
+	"	mov sp, x9\n"
+	"	ldp x19, x20, [sp, #0x00]\n"
+	"	ldp x21, x22, [sp, #0x10]\n"
+	"	ldp x23, x24, [sp, #0x20]\n"
+	"	ldp x25, x26, [sp, #0x30]\n"
+	"	ldp x27, x28, [sp, #0x40]\n"
+	"	ldp x29, x30, [sp, #0x50]\n"
+	"	ldp d8, d9, [sp, #0x60]\n"
+	"	ldp d10, d11, [sp, #0x70]\n"
+	"	ldp d12, d13, [sp, #0x80]\n"
+	"	ldp d14, d15, [sp, #0x90]\n"
+	"	add sp, sp, #0xa0\n"
+	"	ret\n"
+	".size uthread_ctx_switch, .-uthread_ctx_switch\n"
+	"\n"
+	".type uthread_ctx_trampoline, %function\n"
+	"uthread_ctx_trampoline:\n"
+	"	mov x0, x19\n"
+	"	mov x1, x20\n"
+	"	blr x21\n"
+	"	brk #0\n"
+	".size uthread_ctx_trampoline, .-uthread_ctx_trampoline\n"
+);
+
+/* Layout of the 0xa0 bytes frame saved by uthread_ctx_switch() */
+enum { FRAME_X19, FRAME_X20, FRAME_X21, FRAME_X22, FRAME_X23, FRAME_X24,
+       FRAME_X25, FRAME_X26, FRAME_X27, FRAME_X28, FRAME_X29, FRAME_RET,
+       FRAME_D8_D15, FRAME_WORDS = FRAME_D8_D15 + 8 };
+#define FRAME_FUNC	FRAME_X19
+#define FRAME_ARG	FRAME_X20
+#define FRAME_ENTRY	FRAME_X21
+#endif
+
+void uthread_ctx_trampoline(void);
+
+#else /* !UTHREAD_CTX_ASM */
 
 void uthread_ctx_switch(uthread_ctx_t *prev, uthread_ctx_t *next)
 {
@@ -18,15 +126,239 @@ void uthread_ctx_switch(uthread_ctx_t *prev, uthread_ctx_t *next)
 		exit(1);
 	}
 }
+#endif /* UTHREAD_CTX_ASM */
+
+/*
+ * Stack allocation
+ *
+ * Stacks are private anonymous mappings, so the kernel only commits the pages
+ * a thread actually touches. A guard area can be mapped PROT_NONE right below
+ * a stack, so that overflowing it faults instead of silently corrupting the
+ * neighbouring memory.
+ *
+ * Stacks of exited threads are kept on per size class free lists, from 4 KiB
+ * to 1 MiB in powers of two, and handed out again to new threads. Stacks with
+ * no guard area and with a single guard page are pooled separately. The free
+ * lists are intrusive: an idle stack stores the link to the next one in its
+ * lowest (deepest, so least recently touched) word.
+ *
+ * Up to `stack_pool_high_water` stacks per class are kept warm. Stacks released
+ * above that mark are trimmed with madvise(MADV_DONTNEED) and go to a cold list,
+ * which is only used once the warm one is empty.
+ *
+ * Each size class has its own lock, as stacks can be allocated and released by
+ * several kernel threads at once.
+ */
+#define STACK_CLASS_MIN_SHIFT 12
+#define STACK_CLASS_MAX_SHIFT 20
+#define STACK_CLASSES (STACK_CLASS_MAX_SHIFT - STACK_CLASS_MIN_SHIFT + 1)
+
+/* Pooled guard area sizes: none, or one page */
+#define STACK_GUARDS 2
+
+/* Default number of warm stacks kept per size class */
+#define STACK_POOL_HIGH_WATER 64
+
+struct pool_stack {
+	struct pool_stack *next;
+};
+
+struct stack_class {
+	spinlock_t lock;
+	struct pool_stack *warm;
+	struct pool_stack *cold;
+	size_t warm_count;
+};
+
+static struct stack_class stack_pool[STACK_GUARDS][STACK_CLASSES];
+static size_t stack_pool_high_water = STACK_POOL_HIGH_WATER;
+
+/*
+ * page_round - Round a size up to a multiple of the page size
+ * @size: Size to round
+ */
+static size_t page_round(size_t size)
+{
+	size_t page = sysconf(_SC_PAGESIZE);
+
+	return (size + page - 1) & ~(page - 1);
+}
+
+/*
+ * stack_class - Find the pool holding stacks of a given size
+ * @size: Requested size of the stack
+ * @guard: Requested size of the guard area
+ *
+ * Return: Free lists for @size bytes stacks with a @guard bytes guard area, or
+ * NULL if such stacks are not pooled
+ */
+static struct stack_class *stack_class(size_t size, size_t guard)
+{
+	int shift = STACK_CLASS_MIN_SHIFT;
+	size_t guard_pages = page_round(guard) / sysconf(_SC_PAGESIZE);
+
+	if (guard_pages >= STACK_GUARDS)
+		return NULL;
+
+	while (((size_t)1 << shift) < size)
+		if (++shift > STACK_CLASS_MAX_SHIFT)
+			return NULL;
+
+	return &stack_pool[guard_pages][shift - STACK_CLASS_MIN_SHIFT];
+}
 
-void *uthread_ctx_alloc_stack(void)
+/*
+ * stack_alloc_size - Size actually allocated for a stack
+ * @size: Requested size of the stack
+ *
+ * Return: @size rounded up to its size class, or to a page if it is too large
+ * to be pooled
+ */
+static size_t stack_alloc_size(size_t size)
 {
-	return malloc(UTHREAD_STACK_SIZE);
+	int shift = STACK_CLASS_MIN_SHIFT;
+
+	while (((size_t)1 << shift) < size)
+		if (++shift > STACK_CLASS_MAX_SHIFT)
+			return page_round(size);
+
+	return (size_t)1 << shift;
 }
 
-void uthread_ctx_destroy_stack(void *top_of_stack)
+/*
+ * stack_map - Map a new stack
+ * @size: Size of the stack, as rounded by stack_alloc_size()
+ * @guard: Size of the guard area, as rounded by page_round()
+ *
+ * Return: Lowest address of the stack, or NULL in case of failure
+ */
+static void *stack_map(size_t size, size_t guard)
 {
-	free(top_of_stack);
+	char *base;
+
+	base = mmap(NULL, guard + size, PROT_READ | PROT_WRITE,
+		    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK,
+		    -1, 0);
+	if (base == MAP_FAILED)
+		return NULL;
+
+	if (guard && mprotect(base, guard, PROT_NONE)) {
+		munmap(base, guard + size);
+		return NULL;
+	}
+
+	return base + guard;
+}
+
+/*
+ * stack_unmap - Unmap a stack and its guard area
+ * @stack: Lowest address of the stack
+ * @size: Size of the stack, as rounded by stack_alloc_size()
+ * @guard: Size of the guard area, as rounded by page_round()
+ */
+static void stack_unmap(void *stack, size_t size, size_t guard)
+{
+	munmap((char *)stack - guard, guard + size);
+}
+
+void uthread_set_stack_cache(size_t high_water)
+{
+	stack_pool_high_water = high_water;
+}
+
+void *uthread_ctx_alloc_stack(size_t size, size_t guard)
+{
+	struct stack_class *sc = stack_class(size, guard);
+	struct pool_stack *stack;
+
+	if (sc) {
+		spin_lock(&sc->lock);
+
+		/* Prefer warm stacks, their pages are still mapped in */
+		if (sc->warm) {
+			stack = sc->warm;
+			sc->warm = stack->next;
+			sc->warm_count--;
+		} else if (sc->cold) {
+			stack = sc->cold;
+			sc->cold = stack->next;
+		} else {
+			stack = NULL;
+		}
+
+		spin_unlock(&sc->lock);
+		if (stack)
+			return stack;
+	}
+
+	return stack_map(stack_alloc_size(size), page_round(guard));
+}
+
+void uthread_ctx_destroy_stack(void *top_of_stack, size_t size, size_t guard)
+{
+	struct stack_class *sc = stack_class(size, guard);
+	struct pool_stack *stack = top_of_stack;
+	size_t page, alloc_size = stack_alloc_size(size);
+
+	if (!sc) {
+		stack_unmap(top_of_stack, alloc_size, page_round(guard));
+		return;
+	}
+
+	spin_lock(&sc->lock);
+	if (sc->warm_count < stack_pool_high_water) {
+		stack->next = sc->warm;
+		sc->warm = stack;
+		sc->warm_count++;
+		spin_unlock(&sc->lock);
+		return;
+	}
+	spin_unlock(&sc->lock);
+
+	/* Above the high-water mark, only keep the page holding the link */
+	page = sysconf(_SC_PAGESIZE);
+	if (alloc_size > page)
+		madvise((char *)stack + page, alloc_size - page, MADV_DONTNEED);
+
+	spin_lock(&sc->lock);
+	stack->next = sc->cold;
+	sc->cold = stack;
+	spin_unlock(&sc->lock);
+}
+
+/*
+ * stack_list_unmap - Unmap every stack of a free list
+ * @stack: Head of the free list
+ * @size: Size of the stacks in the list
+ * @guard: Size of the guard area of the stacks in the list
+ */
+static void stack_list_unmap(struct pool_stack *stack, size_t size,
+			     size_t guard)
+{
+	while (stack) {
+		struct pool_stack *next = stack->next;
+
+		stack_unmap(stack, size, guard);
+		stack = next;
+	}
+}
+
+void uthread_ctx_release_stacks(void)
+{
+	size_t page = sysconf(_SC_PAGESIZE);
+
+	for (int g = 0; g < STACK_GUARDS; g++) {
+		for (int i = 0; i < STACK_CLASSES; i++) {
+			struct stack_class *sc = &stack_pool[g][i];
+			size_t size = (size_t)1 << (i + STACK_CLASS_MIN_SHIFT);
+
+			stack_list_unmap(sc->warm, size, g * page);
+			stack_list_unmap(sc->cold, size, g * page);
+			sc->warm = NULL;
+			sc->cold = NULL;
+			sc->warm_count = 0;
+		}
+	}
 }
 
 /*
@@ -37,15 +369,45 @@ void uthread_ctx_destroy_stack(void *top_of_stack)
 static void uthread_ctx_bootstrap(uthread_func_t func, void *arg)
 {
 	/*
-	 * Enable interrupts right after being elected to run for the first time
+	 * Complete the switch to this new thread, and enable interrupts right
+	 * after being elected to run for the first time
 	 */
+	uthread_switch_finish();
 	preempt_enable();
 	/* Execute thread and when done, exit */
 	func(arg);
-	uthread_exit();
+	uthread_exit(NULL);
 }
 
-int uthread_ctx_init(uthread_ctx_t *uctx, void *top_of_stack,
+#ifdef UTHREAD_CTX_ASM
+int uthread_ctx_init(uthread_ctx_t *uctx, void *top_of_stack, size_t size,
+		     uthread_func_t func, void *arg)
+{
+	uintptr_t top;
+	uintptr_t *frame;
+
+	/*
+	 * Build the frame that uthread_ctx_switch() expects to find when
+	 * switching to @uctx for the first time. The stack pointer must be
+	 * 16-byte aligned once the frame has been popped, as required by both
+	 * ABIs when calling uthread_ctx_bootstrap().
+	 */
+	top = ((uintptr_t)top_of_stack + size) & ~(uintptr_t)15;
+	frame = (uintptr_t *)top - FRAME_WORDS;
+
+	for (int i = 0; i < FRAME_WORDS; i++)
+		frame[i] = 0;
+	frame[FRAME_FUNC] = (uintptr_t)func;
+	frame[FRAME_ARG] = (uintptr_t)arg;
+	frame[FRAME_ENTRY] = (uintptr_t)uthread_ctx_bootstrap;
+	frame[FRAME_RET] = (uintptr_t)uthread_ctx_trampoline;
+
+	uctx->sp = frame;
+
+	return 0;
+}
+#else /* !UTHREAD_CTX_ASM */
+int uthread_ctx_init(uthread_ctx_t *uctx, void *top_of_stack, size_t size,
 		     uthread_func_t func, void *arg)
 {
 	/*
@@ -58,7 +420,7 @@ int uthread_ctx_init(uthread_ctx_t *uctx, void *top_of_stack,
 	 * Change context @uctx's stack to the specified stack
 	 */
 	uctx->uc_stack.ss_sp = top_of_stack;
-	uctx->uc_stack.ss_size = UTHREAD_STACK_SIZE;
+	uctx->uc_stack.ss_size = size;
 
 	/*
 	 * Finish setting up context @uctx:
@@ -72,3 +434,4 @@ int uthread_ctx_init(uthread_ctx_t *uctx, void *top_of_stack,
 
 	return 0;
 }
+#endif /* UTHREAD_CTX_ASM */
@@ -0,0 +1,202 @@
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "private.h"
+
+/* Number of items a new deque can hold, must be a power of two */
+#define DEQUE_INITIAL_SIZE 256
+
+/*
+ * Items live in items[top & mask] to items[(bottom - 1) & mask]. Outgrown
+ * arrays are chained through `retired` until the deque is destroyed.
+ */
+struct deque_array
+{
+	long mask;
+	struct deque_array *retired;
+	void *items[];
+};
+
+/**
+ * @brief Allocate an array of items
+ *
+ * @param size Number of items, must be a power of two
+ * @param retired Array this one replaces, NULL if none
+ * @return Returns the new array, NULL in case of failure
+ */
+static struct deque_array *deque_array_create(long size,
+					      struct deque_array *retired)
+{
+	struct deque_array *array = malloc(sizeof(struct deque_array) +
+					   size * sizeof(void *));
+
+	if(array == NULL)
+	{
+		return NULL;
+	}
+
+	array->mask = size - 1;
+	array->retired = retired;
+	return array;
+}
+
+/**
+ * @brief Initialize an empty deque
+ *
+ * @param deque Deque to initialize
+ * @return Returns 0 if @deque was initialized, -1 in case of memory
+ * allocation error
+ */
+int deque_init(struct deque *deque)
+{
+	deque->top = 0;
+	deque->bottom = 0;
+	deque->array = deque_array_create(DEQUE_INITIAL_SIZE, NULL);
+
+	return deque->array ? 0 : -1;
+}
+
+/**
+ * @brief Free the current and outgrown arrays of @deque
+ *
+ * @param deque Deque to destroy
+ * @return none
+ */
+void deque_destroy(struct deque *deque)
+{
+	struct deque_array *array = deque->array;
+
+	while(array)
+	{
+		struct deque_array *retired = array->retired;
+
+		free(array);
+		array = retired;
+	}
+	deque->array = NULL;
+}
+
+/**
+ * @brief Push @item at the bottom of @deque, growing it if full
+ *
+ * @param deque Deque owned by the calling kernel thread
+ * @param item Item to push
+ * @return Returns 0 if @item was pushed, -1 in case of memory allocation error
+ */
+int deque_push(struct deque *deque, void *item)
+{
+	long bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED);
+	long top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+	struct deque_array *array = __atomic_load_n(&deque->array, __ATOMIC_RELAXED);
+
+	if(bottom - top > array->mask)
+	{
+		struct deque_array *grown = deque_array_create(2 * (array->mask + 1),
+								 array);
+		if(grown == NULL)
+		{
+			return -1;
+		}
+
+		for(long i = top; i < bottom; i++)
+		{
+			grown->items[i & grown->mask] = array->items[i & array->mask];
+		}
+
+		__atomic_store_n(&deque->array, grown, __ATOMIC_RELEASE);
+		array = grown;
+	}
+
+	__atomic_store_n(&array->items[bottom & array->mask], item, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	__atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+
+	return 0;
+}
+
+/**
+ * @brief Take the most recently pushed item of @deque
+ *
+ * @param deque Deque owned by the calling kernel thread
+ * @return Returns the item, NULL if @deque is empty
+ */
+void *deque_take(struct deque *deque)
+{
+	long bottom = __atomic_load_n(&deque->bottom, __ATOMIC_RELAXED) - 1;
+	struct deque_array *array = __atomic_load_n(&deque->array, __ATOMIC_RELAXED);
+	void *item = NULL;
+
+	/* Claim the bottom item before looking at what thieves are up to */
+	__atomic_store_n(&deque->bottom, bottom, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	long top = __atomic_load_n(&deque->top, __ATOMIC_RELAXED);
+
+	if(top <= bottom)
+	{
+		item = __atomic_load_n(&array->items[bottom & array->mask],
+				       __ATOMIC_RELAXED);
+
+		/* Last item, race the thieves for it */
+		if(top == bottom)
+		{
+			if(!__atomic_compare_exchange_n(&deque->top, &top, top + 1, false,
+							__ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+			{
+				item = NULL;
+			}
+			__atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+		}
+	}
+	else
+	{
+		__atomic_store_n(&deque->bottom, bottom + 1, __ATOMIC_RELAXED);
+	}
+
+	return item;
+}
+
+/**
+ * @brief Steal the least recently pushed item of @deque
+ *
+ * @param deque Deque owned by another kernel thread
+ * @return Returns the item, NULL if @deque is empty or if the item was taken
+ * by someone else first
+ */
+void *deque_steal(struct deque *deque)
+{
+	long top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	long bottom = __atomic_load_n(&deque->bottom, __ATOMIC_ACQUIRE);
+
+	if(top >= bottom)
+	{
+		return NULL;
+	}
+
+	struct deque_array *array = __atomic_load_n(&deque->array, __ATOMIC_ACQUIRE);
+	void *item = __atomic_load_n(&array->items[top & array->mask],
+				     __ATOMIC_RELAXED);
+
+	if(!__atomic_compare_exchange_n(&deque->top, &top, top + 1, false,
+					__ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+	{
+		return NULL;
+	}
+
+	return item;
+}
+
+/**
+ * @brief Check whether @deque looks empty, the answer may be stale as soon as
+ * it is returned
+ *
+ * @param deque Deque to check
+ * @return Returns true if @deque has no items
+ */
+bool deque_empty(struct deque *deque)
+{
+	long top = __atomic_load_n(&deque->top, __ATOMIC_ACQUIRE);
+	long bottom = __atomic_load_n(&deque->bottom, __ATOMIC_ACQUIRE);
+
+	return top >= bottom;
+}
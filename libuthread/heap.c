@@ -0,0 +1,170 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "private.h"
+
+/**
+ * @brief Compare two entries of a heap
+ *
+ * @param a First entry
+ * @param b Second entry
+ * @return Returns true if @a comes out of the heap before @b
+ */
+static bool heap_before(const struct heap_entry *a, const struct heap_entry *b)
+{
+	return a->key < b->key || (a->key == b->key && a->seq < b->seq);
+}
+
+/**
+ * @brief Initialize an empty heap
+ *
+ * @param heap Heap to initialize
+ * @param size Number of items the heap can hold at first, must not be 0
+ * @return Returns 0 if @heap was initialized, -1 in case of memory allocation
+ * error
+ */
+int heap_init(struct heap *heap, size_t size)
+{
+	heap->entries = malloc(size * sizeof(struct heap_entry));
+	heap->length = 0;
+	heap->capacity = size;
+	heap->reserved = 0;
+	heap->seq = 0;
+
+	return heap->entries ? 0 : -1;
+}
+
+/**
+ * @brief Free the memory of a heap
+ *
+ * @param heap Heap to destroy
+ * @return none
+ */
+void heap_destroy(struct heap *heap)
+{
+	free(heap->entries);
+	heap->entries = NULL;
+}
+
+/**
+ * @brief Make sure @heap has room for one more item, growing it if needed
+ *
+ * @param heap Heap to reserve room in
+ * @return Returns 0 in case of success, -1 in case of memory allocation error
+ */
+int heap_reserve(struct heap *heap)
+{
+	if(heap->reserved == heap->capacity)
+	{
+		struct heap_entry *entries = realloc(heap->entries, 2 * heap->capacity *
+						     sizeof(struct heap_entry));
+		if(entries == NULL)
+		{
+			return -1;
+		}
+
+		heap->entries = entries;
+		heap->capacity *= 2;
+	}
+
+	heap->reserved++;
+	return 0;
+}
+
+/**
+ * @brief Give back the room reserved for an item
+ *
+ * @param heap Heap the room was reserved in
+ * @return none
+ */
+void heap_unreserve(struct heap *heap)
+{
+	heap->reserved--;
+}
+
+/**
+ * @brief Insert an item in @heap, in room reserved beforehand
+ *
+ * @param heap Heap to insert @item in
+ * @param key Key of @item
+ * @param item Item to insert
+ * @return none
+ */
+void heap_push(struct heap *heap, uint64_t key, void *item)
+{
+	struct heap_entry entry = { .key = key, .seq = heap->seq++, .item = item };
+
+	/* Sift up */
+	size_t i = heap->length++;
+	while(i > 0 && heap_before(&entry, &heap->entries[(i - 1) / 2]))
+	{
+		heap->entries[i] = heap->entries[(i - 1) / 2];
+		i = (i - 1) / 2;
+	}
+	heap->entries[i] = entry;
+}
+
+/**
+ * @brief Remove the item with the lowest key from @heap, the oldest one among
+ * equal keys
+ *
+ * @param heap Heap to remove the item from
+ * @param key Set to the key of the item, may be NULL
+ * @return Returns the item, NULL if @heap is empty
+ */
+void *heap_pop(struct heap *heap, uint64_t *key)
+{
+	if(heap->length == 0)
+	{
+		return NULL;
+	}
+
+	struct heap_entry top = heap->entries[0];
+	struct heap_entry last = heap->entries[--heap->length];
+
+	/* Sift the last entry down from the root */
+	size_t i = 0;
+	while(2 * i + 1 < heap->length)
+	{
+		size_t child = 2 * i + 1;
+
+		if(child + 1 < heap->length &&
+		   heap_before(&heap->entries[child + 1], &heap->entries[child]))
+		{
+			child++;
+		}
+		if(!heap_before(&heap->entries[child], &last))
+		{
+			break;
+		}
+
+		heap->entries[i] = heap->entries[child];
+		i = child;
+	}
+	heap->entries[i] = last;
+
+	if(key)
+	{
+		*key = top.key;
+	}
+	return top.item;
+}
+
+/**
+ * @brief Get the lowest key of @heap
+ *
+ * @param heap Heap to look into
+ * @param key Set to the lowest key
+ * @return Returns true if @heap is not empty, false otherwise
+ */
+bool heap_min(const struct heap *heap, uint64_t *key)
+{
+	if(heap->length == 0)
+	{
+		return false;
+	}
+
+	*key = heap->entries[0].key;
+	return true;
+}
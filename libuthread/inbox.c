@@ -0,0 +1,268 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+#include "private.h"
+#include "sem.h"
+#include "uthread.h"
+
+/*
+ * Messages posted by kernel threads outside of the scheduler, in a lock-free
+ * multi-producer single-consumer queue: a producer only swaps itself in as the
+ * tail and then links the previous tail to it, and the consumer pops from the
+ * head, going through a stub message to never leave the queue empty. A
+ * producer caught between its two steps makes the queue look empty past the
+ * previous tail for a moment; it writes the poller's eventfd once done, so the
+ * rest is drained by the next poll.
+ *
+ * Workers take turns as the consumer, through draining. queued counts the
+ * messages not drained yet, and holds the references that keep a run going
+ * while external wakeups are expected.
+ */
+static struct inbox_msg stub;
+static struct inbox_msg *head = &stub;
+static struct inbox_msg *tail = &stub;
+static int draining;
+static size_t queued;
+static size_t holds;
+
+/**
+ * @brief Push a message to the queue, from any kernel thread
+ *
+ * @param msg Message to push
+ * @return none
+ */
+static void inbox_push(struct inbox_msg *msg)
+{
+	__atomic_store_n(&msg->next, NULL, __ATOMIC_RELAXED);
+	struct inbox_msg *prev = __atomic_exchange_n(&tail, msg, __ATOMIC_ACQ_REL);
+	__atomic_store_n(&prev->next, msg, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Pop the oldest message from the queue, draining must be held
+ *
+ * @param none
+ * @return struct inbox_msg popped, NULL if there is none, or if the next one is
+ * not linked yet
+ */
+static struct inbox_msg *inbox_pop(void)
+{
+	struct inbox_msg *first = head;
+	struct inbox_msg *next = __atomic_load_n(&first->next, __ATOMIC_ACQUIRE);
+
+	/* Skip the stub */
+	if(first == &stub)
+	{
+		if(next == NULL)
+		{
+			return NULL;
+		}
+		head = first = next;
+		next = __atomic_load_n(&first->next, __ATOMIC_ACQUIRE);
+	}
+
+	if(next)
+	{
+		head = next;
+		return first;
+	}
+
+	/* A producer swapped itself in, but did not link first to it yet */
+	if(first != __atomic_load_n(&tail, __ATOMIC_ACQUIRE))
+	{
+		return NULL;
+	}
+
+	/* first is the last message, put the stub behind it to pop it */
+	inbox_push(&stub);
+	next = __atomic_load_n(&first->next, __ATOMIC_ACQUIRE);
+	if(next)
+	{
+		head = next;
+		return first;
+	}
+	return NULL;
+}
+
+/**
+ * @brief Post a message to the scheduler, from any kernel thread, and wake up
+ * a worker blocked in the poller
+ *
+ * @param msg Message to post, with its type and argument set
+ * @return none
+ */
+void inbox_post(struct inbox_msg *msg)
+{
+	/* Messages are only seen by workers polling for them */
+	netpoll_init();
+
+	__atomic_add_fetch(&queued, 1, __ATOMIC_SEQ_CST);
+	inbox_push(msg);
+	netpoll_break();
+}
+
+/**
+ * @brief Check whether messages wait to be drained
+ *
+ * @param none
+ * @return Returns true if the inbox is not empty
+ */
+bool inbox_ready(void)
+{
+	return __atomic_load_n(&queued, __ATOMIC_SEQ_CST) != 0;
+}
+
+/**
+ * @brief Check whether a message may still come
+ *
+ * @param none
+ * @return Returns true if the inbox is not empty, or references are held
+ */
+bool inbox_pending(void)
+{
+	return __atomic_load_n(&holds, __ATOMIC_SEQ_CST) != 0 || inbox_ready();
+}
+
+/**
+ * @brief Carry out the messages waiting in the inbox
+ *
+ * @param threads Set to the threads the messages make ready
+ * @param max Most threads to make ready
+ * @return size_t - Number of threads in @threads
+ */
+size_t inbox_drain(struct uthread_tcb **threads, size_t max)
+{
+	struct inbox_msg *msg;
+	size_t count = 0;
+
+	/* A single consumer at a time, the others leave it to that one */
+	if(!inbox_ready() || __atomic_exchange_n(&draining, 1, __ATOMIC_ACQUIRE))
+	{
+		return 0;
+	}
+
+	while(count < max && (msg = inbox_pop()))
+	{
+		struct uthread_tcb *thread = NULL;
+
+		switch(msg->type)
+		{
+		case INBOX_UNBLOCK:
+			thread = msg->thread;
+			break;
+		case INBOX_SEM_UP:
+			thread = sem_release(msg->sem);
+			break;
+		case INBOX_CREATE:
+			thread = uthread_create_detached(msg->func, msg->arg);
+			break;
+		}
+
+		if(thread)
+		{
+			threads[count++] = thread;
+		}
+		if(msg->allocated)
+		{
+			free(msg);
+		}
+		__atomic_sub_fetch(&queued, 1, __ATOMIC_SEQ_CST);
+	}
+
+	__atomic_store_n(&draining, 0, __ATOMIC_RELEASE);
+	return count;
+}
+
+/**
+ * @brief Allocate a message and post it
+ *
+ * @param type Type of the message
+ * @param fill Message whose arguments to copy
+ * @return int - 0 in case of success, -1 in case of memory allocation error
+ */
+static int inbox_send(int type, const struct inbox_msg *fill)
+{
+	struct inbox_msg *msg = malloc(sizeof(*msg));
+
+	if(msg == NULL)
+	{
+		return -1;
+	}
+
+	*msg = *fill;
+	msg->type = type;
+	msg->allocated = true;
+	inbox_post(msg);
+	return 0;
+}
+
+/**
+ * @brief Unblock a blocked thread from a kernel thread outside of the
+ * scheduler
+ *
+ * @param uthread TCB of thread we want to unblock
+ * @return int - 0 in case of success, -1 in case of failure
+ */
+int uthread_unblock_external(struct uthread_tcb *uthread)
+{
+	struct inbox_msg fill = { .thread = uthread };
+
+	return uthread ? inbox_send(INBOX_UNBLOCK, &fill) : -1;
+}
+
+/**
+ * @brief Release a resource to a semaphore from a kernel thread outside of the
+ * scheduler
+ *
+ * @param sem Semaphore to release
+ * @return int - 0 in case of success, -1 in case of failure
+ */
+int sem_up_external(sem_t sem)
+{
+	struct inbox_msg fill = { .sem = sem };
+
+	return sem ? inbox_send(INBOX_SEM_UP, &fill) : -1;
+}
+
+/**
+ * @brief Create a detached thread from a kernel thread outside of the
+ * scheduler
+ *
+ * @param func Function to be executed by created thread
+ * @param arg Arguments to be passed to the created thread
+ * @return int - 0 in case of success, -1 in case of failure
+ */
+int uthread_create_external(uthread_func_t func, void *arg)
+{
+	struct inbox_msg fill = { .func = func, .arg = arg };
+
+	return func ? inbox_send(INBOX_CREATE, &fill) : -1;
+}
+
+/**
+ * @brief Keep the run going until a matching uthread_external_release()
+ *
+ * @param none
+ * @return none
+ */
+void uthread_external_hold(void)
+{
+	netpoll_init();
+	__atomic_add_fetch(&holds, 1, __ATOMIC_SEQ_CST);
+}
+
+/**
+ * @brief Drop a reference taken with uthread_external_hold()
+ *
+ * @param none
+ * @return none
+ */
+void uthread_external_release(void)
+{
+	/* The run may be over now, let a worker blocked in the poller find out */
+	if(__atomic_sub_fetch(&holds, 1, __ATOMIC_SEQ_CST) == 0)
+	{
+		netpoll_break();
+	}
+}
@@ -0,0 +1,142 @@
+#ifndef _LIST_H
+#define _LIST_H
+
+/*
+ * This header is only meant to be included by files from the libuthread. It
+ * defines the intrusive lists used by the scheduler, which queue objects
+ * without allocating any memory.
+ */
+
+#include <stddef.h>
+
+/*
+ * struct list_node - Intrusive list link
+ *
+ * A list node is embedded in the object to be queued (e.g. a TCB), and the
+ * object is found back from its node with list_entry(). A node can only be in
+ * one list at a time.
+ */
+struct list_node {
+	struct list_node *prev;
+	struct list_node *next;
+};
+
+/*
+ * struct list - Intrusive FIFO list
+ *
+ * A circular doubly-linked list with a sentinel node, so that all the
+ * operations below are O(1), including removing a node from the middle of the
+ * list.
+ */
+struct list {
+	struct list_node head;
+	size_t length;
+};
+
+/*
+ * list_entry - Get the object a list node is embedded in
+ * @node: Pointer to the list node
+ * @type: Type of the object
+ * @member: Name of the list node member within @type
+ */
+#define list_entry(node, type, member) \
+	((type *)((char *)(node) - offsetof(type, member)))
+
+/*
+ * list_init - Initialize an empty list
+ * @list: List to initialize
+ */
+static inline void list_init(struct list *list)
+{
+	list->head.prev = &list->head;
+	list->head.next = &list->head;
+	list->length = 0;
+}
+
+/*
+ * list_length - List length
+ * @list: List to get the length of
+ */
+static inline size_t list_length(const struct list *list)
+{
+	return list->length;
+}
+
+/*
+ * list_first - Oldest node of a list
+ * @list: List to look into
+ *
+ * Return: Oldest node of @list, or NULL if @list is empty
+ */
+static inline struct list_node *list_first(const struct list *list)
+{
+	return list->length ? list->head.next : NULL;
+}
+
+/*
+ * list_insert - Insert a node between two adjacent nodes
+ * @list: List the nodes belong to
+ * @node: Node to insert
+ * @prev: Node to insert @node after
+ * @next: Node to insert @node before
+ */
+static inline void list_insert(struct list *list, struct list_node *node,
+			       struct list_node *prev, struct list_node *next)
+{
+	node->prev = prev;
+	node->next = next;
+	prev->next = node;
+	next->prev = node;
+	list->length++;
+}
+
+/*
+ * list_push_back - Enqueue a node at the end of a list
+ * @list: List in which to enqueue @node
+ * @node: Node to enqueue
+ */
+static inline void list_push_back(struct list *list, struct list_node *node)
+{
+	list_insert(list, node, list->head.prev, &list->head);
+}
+
+/*
+ * list_push_front - Enqueue a node at the front of a list
+ * @list: List in which to enqueue @node
+ * @node: Node to enqueue
+ */
+static inline void list_push_front(struct list *list, struct list_node *node)
+{
+	list_insert(list, node, &list->head, list->head.next);
+}
+
+/*
+ * list_remove - Remove a node from a list
+ * @list: List @node is in
+ * @node: Node to remove
+ */
+static inline void list_remove(struct list *list, struct list_node *node)
+{
+	node->prev->next = node->next;
+	node->next->prev = node->prev;
+	node->prev = node->next = NULL;
+	list->length--;
+}
+
+/*
+ * list_pop_front - Dequeue the oldest node of a list
+ * @list: List from which to dequeue
+ *
+ * Return: Oldest node of @list, or NULL if @list is empty
+ */
+static inline struct list_node *list_pop_front(struct list *list)
+{
+	struct list_node *node = list_first(list);
+
+	if (node)
+		list_remove(list, node);
+
+	return node;
+}
+
+#endif /* _LIST_H */
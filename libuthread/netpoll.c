@@ -0,0 +1,830 @@
+/* For accept4() */
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "netpoll.h"
+#include "private.h"
+#include "spinlock.h"
+
+#define NETPOLL_READ 0
+#define NETPOLL_WRITE 1
+
+/* Each event makes ready at most a reader and a writer */
+#define NETPOLL_EVENTS (NETPOLL_BATCH / 2)
+
+/* Number of file descriptors the table can hold at first */
+#define DESC_INITIAL_SIZE 64
+
+/* Longest a poll waits (in ns) while the ring holds requests not submitted */
+#define URING_RETRY 1000000
+
+/*
+ * State of a file descriptor used by threads. The file descriptor is
+ * registered with epoll once, edge-triggered, for both directions. An event
+ * makes ready the thread waiting in each of them, or, if there is none, is
+ * remembered in ready, so that a thread about to wait tries again instead of
+ * missing the edge. gen changes when the file descriptor is closed, for the
+ * threads it wakes up to tell. A file descriptor epoll refuses, like a regular
+ * file, is marked unpollable the first time, so that it is not probed again.
+ *
+ * Descriptors are never freed, so that events still in flight when the file
+ * descriptor is closed only leave a stale ready flag behind, which at worst
+ * costs a retry.
+ */
+struct netpoll_desc
+{
+	spinlock_t lock;
+	int fd;
+	bool registered;
+	bool unpollable;
+	bool ready[2];
+	struct uthread_tcb *waiter[2];
+	unsigned int gen;
+};
+
+/*
+ * Descriptors indexed by file descriptor, the epoll instance, and the eventfd
+ * that interrupts a blocked poll, all created on first use and protected by
+ * tableLock. Like file descriptors, they last for the whole program.
+ */
+static struct netpoll_desc **descTable;
+static size_t descCapacity;
+static spinlock_t tableLock;
+static int epollFd = -1;
+static int breakFd = -1;
+
+/*
+ * Number of threads waiting for a file descriptor, whether breakFd was
+ * written to since a poll last read it, and number of polls that may block
+ */
+static size_t waiters;
+static int breakPending;
+static int polling;
+
+/*
+ * Whether reads and writes of file descriptors that cannot be polled go
+ * through io_uring, and whether its ring is registered with epoll (under
+ * tableLock), as uringDesc, to wake up a blocked poll when requests complete
+ */
+static bool uringEnabled;
+static bool uringRegistered;
+static struct netpoll_desc uringDesc;
+
+/**
+ * @brief Create the epoll instance and its eventfd, tableLock must be held
+ *
+ * @param none
+ * @return Returns 0 in case of success, -1 in case of failure
+ */
+static int netpoll_setup(void)
+{
+	struct epoll_event event = { .events = EPOLLIN, .data.ptr = NULL };
+
+	if(epollFd >= 0)
+	{
+		return 0;
+	}
+
+	int epfd = epoll_create1(EPOLL_CLOEXEC);
+	if(epfd < 0)
+	{
+		return -1;
+	}
+
+	int efd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if(efd < 0 || epoll_ctl(epfd, EPOLL_CTL_ADD, efd, &event))
+	{
+		if(efd >= 0)
+		{
+			close(efd);
+		}
+		close(epfd);
+		return -1;
+	}
+
+	breakFd = efd;
+	__atomic_store_n(&epollFd, epfd, __ATOMIC_RELEASE);
+	return 0;
+}
+
+/**
+ * @brief Create the epoll instance and its eventfd, if they do not exist yet
+ *
+ * @param none
+ * @return Returns 0 in case of success, -1 in case of failure
+ */
+int netpoll_init(void)
+{
+	int ret;
+
+	if(__atomic_load_n(&epollFd, __ATOMIC_ACQUIRE) >= 0)
+	{
+		return 0;
+	}
+
+	preempt_disable();
+	spin_lock(&tableLock);
+	ret = netpoll_setup();
+	spin_unlock(&tableLock);
+	preempt_enable();
+
+	return ret;
+}
+
+/**
+ * @brief Get the descriptor of a file descriptor, tableLock must be held
+ *
+ * @param fd File descriptor
+ * @param create Whether to create the descriptor if there is none
+ * @return struct netpoll_desc of @fd, NULL if there is none or in case of
+ * memory allocation error
+ */
+static struct netpoll_desc *desc_lookup(int fd, bool create)
+{
+	if((size_t)fd >= descCapacity)
+	{
+		if(!create)
+		{
+			return NULL;
+		}
+
+		size_t capacity = descCapacity ? descCapacity : DESC_INITIAL_SIZE;
+		while(capacity <= (size_t)fd)
+		{
+			capacity *= 2;
+		}
+
+		struct netpoll_desc **table = realloc(descTable,
+						      capacity * sizeof(*table));
+		if(table == NULL)
+		{
+			return NULL;
+		}
+
+		memset(table + descCapacity, 0,
+		       (capacity - descCapacity) * sizeof(*table));
+		descTable = table;
+		descCapacity = capacity;
+	}
+
+	if(descTable[fd] == NULL && create)
+	{
+		descTable[fd] = calloc(1, sizeof(struct netpoll_desc));
+		if(descTable[fd])
+		{
+			descTable[fd]->fd = fd;
+		}
+	}
+
+	return descTable[fd];
+}
+
+/**
+ * @brief Register a file descriptor with the poller, the first time a thread
+ * uses it
+ *
+ * @param fd File descriptor
+ * @return struct netpoll_desc of @fd, NULL if @fd cannot be polled or in case
+ * of failure, in which case it is left as it is
+ */
+static struct netpoll_desc *netpoll_open(int fd)
+{
+	struct netpoll_desc *desc = NULL;
+
+	if(fd < 0)
+	{
+		return NULL;
+	}
+
+	preempt_disable();
+	spin_lock(&tableLock);
+	if(netpoll_setup() == 0)
+	{
+		desc = desc_lookup(fd, true);
+	}
+	spin_unlock(&tableLock);
+
+	if(desc)
+	{
+		spin_lock(&desc->lock);
+		if(!desc->registered && !desc->unpollable)
+		{
+			struct epoll_event event = {
+				.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET,
+				.data.ptr = desc,
+			};
+			int flags = fcntl(fd, F_GETFL);
+
+			/* Regular files cannot be polled, but never block either */
+			if(flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0 &&
+			   epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) == 0)
+			{
+				desc->registered = true;
+				desc->ready[NETPOLL_READ] = false;
+				desc->ready[NETPOLL_WRITE] = false;
+			}
+			else if(flags >= 0)
+			{
+				desc->unpollable = errno == EPERM;
+				fcntl(fd, F_SETFL, flags);
+			}
+		}
+		bool registered = desc->registered;
+
+		spin_unlock(&desc->lock);
+		if(!registered)
+		{
+			desc = NULL;
+		}
+	}
+	preempt_enable();
+
+	return desc;
+}
+
+/**
+ * @brief Wait for a file descriptor to become ready, after a call returned
+ * EAGAIN
+ *
+ * @param desc Descriptor of the file descriptor, NULL if it cannot be polled
+ * @param mode NETPOLL_READ or NETPOLL_WRITE
+ * @return Returns 0 when the call is to be tried again, -1 with errno set
+ * otherwise
+ */
+static int netpoll_wait(struct netpoll_desc *desc, int mode)
+{
+	if(desc == NULL)
+	{
+		return -1;
+	}
+
+	preempt_disable();
+
+	struct uthread_tcb *thread = uthread_current();
+
+	/* Outside of a thread, block the kernel thread */
+	if(thread == NULL)
+	{
+		struct pollfd pfd = {
+			.fd = desc->fd,
+			.events = mode == NETPOLL_READ ? POLLIN : POLLOUT,
+		};
+
+		preempt_enable();
+		return poll(&pfd, 1, -1) < 0 && errno != EINTR ? -1 : 0;
+	}
+
+	spin_lock(&desc->lock);
+
+	/* An event came in since the call was made, or the fd was closed */
+	if(desc->ready[mode] || !desc->registered)
+	{
+		bool registered = desc->registered;
+
+		desc->ready[mode] = false;
+		spin_unlock(&desc->lock);
+		preempt_enable();
+		if(!registered)
+		{
+			errno = EBADF;
+			return -1;
+		}
+		return 0;
+	}
+
+	if(desc->waiter[mode])
+	{
+		spin_unlock(&desc->lock);
+		preempt_enable();
+		errno = EBUSY;
+		return -1;
+	}
+
+	unsigned int gen = desc->gen;
+
+	desc->waiter[mode] = thread;
+	__atomic_add_fetch(&waiters, 1, __ATOMIC_SEQ_CST);
+	spin_unlock(&desc->lock);
+
+	uthread_block();
+
+	/* Woken up by uthread_close() */
+	if(__atomic_load_n(&desc->gen, __ATOMIC_RELAXED) != gen)
+	{
+		errno = EBADF;
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * @brief Read or write a file descriptor that cannot be polled through the
+ * ring, blocking only the calling thread until the request completes
+ *
+ * @param write Whether to write, or read
+ * @param fd File descriptor
+ * @param buf Buffer to read into or write from
+ * @param count Number of bytes to read or write
+ * @param ret Set to the result, like that of read() or write()
+ * @return Returns 0 if the request went through the ring, -1 if it has to be
+ * made another way (io_uring is disabled, the ring is full, or it was called
+ * from outside of a thread)
+ */
+static int netpoll_uring(bool write, int fd, const void *buf, size_t count,
+			 ssize_t *ret)
+{
+	struct uring_req req;
+
+	if(fd < 0 || !__atomic_load_n(&uringEnabled, __ATOMIC_ACQUIRE))
+	{
+		return -1;
+	}
+
+	preempt_disable();
+	req.thread = uthread_current();
+	if(req.thread == NULL || uring_queue(&req, write, fd, buf, count))
+	{
+		preempt_enable();
+		return -1;
+	}
+
+	/*
+	 * Requests are submitted by a scheduling pass once they are due, or by the
+	 * next poll: have one blocked in epoll make its way around
+	 */
+	if(__atomic_load_n(&polling, __ATOMIC_SEQ_CST))
+	{
+		netpoll_break();
+	}
+
+	uthread_block();
+
+	if(req.res < 0)
+	{
+		errno = -req.res;
+		*ret = -1;
+	}
+	else
+	{
+		*ret = req.res;
+	}
+	return 0;
+}
+
+/*
+ * Read or write of a file descriptor that cannot be polled, made by a helper
+ * kernel thread
+ */
+struct netpoll_file_call
+{
+	bool write;
+	int fd;
+	void *buf;
+	size_t count;
+	ssize_t ret;
+	int error;
+};
+
+/**
+ * @brief Make the read or write of a netpoll_file_call, on a helper kernel
+ * thread
+ *
+ * @param arg struct netpoll_file_call to make
+ * @return none
+ */
+static void *netpoll_file_main(void *arg)
+{
+	struct netpoll_file_call *call = arg;
+
+	call->ret = call->write ? write(call->fd, call->buf, call->count) :
+		read(call->fd, call->buf, call->count);
+	call->error = errno;
+	return NULL;
+}
+
+/**
+ * @brief Read or write a file descriptor that cannot be polled, blocking only
+ * the calling thread: through the ring if io_uring is enabled and has room,
+ * otherwise on a helper kernel thread
+ *
+ * @param write Whether to write, or read
+ * @param fd File descriptor
+ * @param buf Buffer to read into or write from
+ * @param count Number of bytes to read or write
+ * @return ssize_t - Like read() or write()
+ */
+static ssize_t netpoll_file(bool write, int fd, const void *buf, size_t count)
+{
+	struct netpoll_file_call call = {
+		.write = write,
+		.fd = fd,
+		.buf = (void *)buf,
+		.count = count,
+	};
+
+	if(netpoll_uring(write, fd, buf, count, &call.ret) == 0)
+	{
+		return call.ret;
+	}
+
+	uthread_offload(netpoll_file_main, &call);
+	if(call.ret < 0)
+	{
+		errno = call.error;
+	}
+	return call.ret;
+}
+
+/**
+ * @brief Hand an event to the thread waiting for it, desc->lock must be held
+ *
+ * @param desc Descriptor the event is for
+ * @param mode NETPOLL_READ or NETPOLL_WRITE
+ * @param threads Array to add the thread to, if one was waiting
+ * @param count Number of threads in @threads, updated
+ * @return none
+ */
+static void netpoll_ready(struct netpoll_desc *desc, int mode,
+			  struct uthread_tcb **threads, size_t *count)
+{
+	if(desc->waiter[mode])
+	{
+		threads[(*count)++] = desc->waiter[mode];
+		desc->waiter[mode] = NULL;
+		__atomic_sub_fetch(&waiters, 1, __ATOMIC_SEQ_CST);
+	}
+	else
+	{
+		desc->ready[mode] = true;
+	}
+}
+
+/**
+ * @brief Check whether threads are waiting for file descriptors
+ *
+ * @param none
+ * @return Returns true if some thread waits for a file descriptor or for a
+ * request to the ring, or if messages may come from other kernel threads
+ */
+bool netpoll_pending(void)
+{
+	return __atomic_load_n(&waiters, __ATOMIC_SEQ_CST) != 0 ||
+		uring_pending() || inbox_pending();
+}
+
+/**
+ * @brief Collect the threads whose file descriptor became ready
+ *
+ * @param timeout Most time to wait for an event (in ns), 0 not to wait, -1 to
+ * wait until one comes or netpoll_break() is called
+ * @param threads Set to the threads to make ready, NETPOLL_BATCH at most
+ * @return Returns the number of threads in @threads
+ */
+size_t netpoll_poll(int64_t timeout, struct uthread_tcb **threads)
+{
+	struct epoll_event events[NETPOLL_EVENTS];
+	struct timespec ts;
+	size_t count = 0;
+	int epfd = __atomic_load_n(&epollFd, __ATOMIC_ACQUIRE);
+	int n;
+
+	if(epfd < 0)
+	{
+		return 0;
+	}
+
+	/* Counted first, for threads queueing requests to know to break it */
+	bool blocking = timeout != 0;
+	if(blocking)
+	{
+		__atomic_add_fetch(&polling, 1, __ATOMIC_SEQ_CST);
+	}
+
+	/* Submit what the threads queued since the last poll all at once */
+	if(!uring_submit() && (timeout < 0 || timeout > URING_RETRY))
+	{
+		timeout = URING_RETRY;
+	}
+	if(uring_completed() || inbox_ready())
+	{
+		timeout = 0;
+	}
+
+	ts.tv_sec = timeout / 1000000000;
+	ts.tv_nsec = timeout % 1000000000;
+	n = epoll_pwait2(epfd, events, NETPOLL_EVENTS, timeout < 0 ? NULL : &ts,
+			 NULL);
+
+	/* Kernels older than 5.11 only wait in milliseconds */
+	if(n < 0 && errno == ENOSYS)
+	{
+		n = epoll_wait(epfd, events, NETPOLL_EVENTS, timeout < 0 ? -1 :
+			       (int)((timeout + 999999) / 1000000));
+	}
+
+	if(blocking)
+	{
+		__atomic_sub_fetch(&polling, 1, __ATOMIC_SEQ_CST);
+	}
+
+	for(int i = 0; i < n; i++)
+	{
+		struct netpoll_desc *desc = events[i].data.ptr;
+		uint32_t ev = events[i].events;
+
+		/*
+		 * The eventfd, also written to when messages are posted to the inbox,
+		 * which may already have been read by another poll
+		 */
+		if(desc == NULL)
+		{
+			eventfd_t value;
+
+			eventfd_read(breakFd, &value);
+			__atomic_store_n(&breakPending, 0, __ATOMIC_RELEASE);
+			continue;
+		}
+
+		/* The ring, whose completions are reaped below */
+		if(desc == &uringDesc)
+		{
+			continue;
+		}
+
+		spin_lock(&desc->lock);
+		if(ev & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+		{
+			netpoll_ready(desc, NETPOLL_READ, threads, &count);
+		}
+		if(ev & (EPOLLOUT | EPOLLHUP | EPOLLERR))
+		{
+			netpoll_ready(desc, NETPOLL_WRITE, threads, &count);
+		}
+		spin_unlock(&desc->lock);
+	}
+
+	count += uring_reap(threads + count, NETPOLL_BATCH - count);
+	return count + inbox_drain(threads + count, NETPOLL_BATCH - count);
+}
+
+/**
+ * @brief Interrupt a blocked netpoll_poll()
+ *
+ * @param none
+ * @return none
+ */
+void netpoll_break(void)
+{
+	int pending = 0;
+
+	/* A single write until a poll reads it is enough */
+	if(__atomic_compare_exchange_n(&breakPending, &pending, 1, false,
+				       __ATOMIC_ACQ_REL, __ATOMIC_RELAXED) &&
+	   eventfd_write(breakFd, 1))
+	{
+		__atomic_store_n(&breakPending, 0, __ATOMIC_RELEASE);
+	}
+}
+
+/**
+ * @brief Enable or disable io_uring for file descriptors that cannot be polled
+ *
+ * @param enable Whether to enable io_uring
+ * @return int - 0 in case of success, -1 if io_uring is unavailable
+ */
+int uthread_set_io_uring(bool enable)
+{
+	bool registered;
+
+	if(!enable)
+	{
+		__atomic_store_n(&uringEnabled, false, __ATOMIC_RELEASE);
+		return 0;
+	}
+
+	preempt_disable();
+	spin_lock(&tableLock);
+	if(!uringRegistered && netpoll_setup() == 0)
+	{
+		struct epoll_event event = {
+			.events = EPOLLIN,
+			.data.ptr = &uringDesc,
+		};
+		int fd = uring_setup();
+
+		uringRegistered = fd >= 0 &&
+			epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) == 0;
+	}
+	registered = uringRegistered;
+	spin_unlock(&tableLock);
+	preempt_enable();
+
+	if(!registered)
+	{
+		return -1;
+	}
+
+	__atomic_store_n(&uringEnabled, true, __ATOMIC_RELEASE);
+	return 0;
+}
+
+/**
+ * @brief Read from a file descriptor, blocking only the calling thread
+ *
+ * @param fd File descriptor to read from
+ * @param buf Buffer to read into
+ * @param count Maximum number of bytes to read
+ * @return ssize_t - Number of bytes read, -1 in case of failure
+ */
+ssize_t uthread_read(int fd, void *buf, size_t count)
+{
+	struct netpoll_desc *desc = netpoll_open(fd);
+	ssize_t ret;
+
+	if(desc == NULL)
+	{
+		return netpoll_file(false, fd, buf, count);
+	}
+
+	while((ret = read(fd, buf, count)) < 0 && errno == EAGAIN &&
+	      netpoll_wait(desc, NETPOLL_READ) == 0);
+
+	return ret;
+}
+
+/**
+ * @brief Write to a file descriptor, blocking only the calling thread
+ *
+ * @param fd File descriptor to write to
+ * @param buf Buffer to write from
+ * @param count Number of bytes to write
+ * @return ssize_t - Number of bytes written, -1 in case of failure
+ */
+ssize_t uthread_write(int fd, const void *buf, size_t count)
+{
+	struct netpoll_desc *desc = netpoll_open(fd);
+	ssize_t ret;
+
+	if(desc == NULL)
+	{
+		return netpoll_file(true, fd, buf, count);
+	}
+
+	while((ret = write(fd, buf, count)) < 0 && errno == EAGAIN &&
+	      netpoll_wait(desc, NETPOLL_WRITE) == 0);
+
+	return ret;
+}
+
+/**
+ * @brief Accept a connection, blocking only the calling thread
+ *
+ * @param sockfd Listening socket
+ * @param addr Set to the address of the peer, may be NULL
+ * @param addrlen Size of @addr, set to the size of the peer's address
+ * @return int - File descriptor of the new socket, -1 in case of failure
+ */
+int uthread_accept(int sockfd, struct sockaddr *addr, socklen_t *addrlen)
+{
+	struct netpoll_desc *desc = netpoll_open(sockfd);
+	int ret;
+
+	while((ret = accept4(sockfd, addr, addrlen, SOCK_NONBLOCK)) < 0 &&
+	      errno == EAGAIN && netpoll_wait(desc, NETPOLL_READ) == 0);
+
+	return ret;
+}
+
+/**
+ * @brief Connect a socket, blocking only the calling thread
+ *
+ * @param sockfd Socket to connect
+ * @param addr Address to connect to
+ * @param addrlen Size of @addr
+ * @return int - 0 once connected, -1 in case of failure
+ */
+int uthread_connect(int sockfd, const struct sockaddr *addr, socklen_t addrlen)
+{
+	struct netpoll_desc *desc = netpoll_open(sockfd);
+	struct sockaddr_storage peer;
+	socklen_t len;
+	int error;
+
+	if(connect(sockfd, addr, addrlen) == 0)
+	{
+		return 0;
+	}
+	if(errno != EINPROGRESS || desc == NULL)
+	{
+		return -1;
+	}
+
+	/*
+	 * The socket was registered before connecting, while it reported EPOLLOUT
+	 * as it was not connected yet: forget that event, and only then look at
+	 * whether the connection is done, so that the event it sends is not lost
+	 */
+	preempt_disable();
+	spin_lock(&desc->lock);
+	desc->ready[NETPOLL_WRITE] = false;
+	spin_unlock(&desc->lock);
+	preempt_enable();
+
+	/*
+	 * The socket becomes writable once the connection is done, or failed, but
+	 * an event left over from before may still come in: wait until it has a
+	 * peer
+	 */
+	while(true)
+	{
+		len = sizeof(error);
+		if(getsockopt(sockfd, SOL_SOCKET, SO_ERROR, &error, &len))
+		{
+			return -1;
+		}
+		if(error)
+		{
+			errno = error;
+			return -1;
+		}
+
+		len = sizeof(peer);
+		if(getpeername(sockfd, (struct sockaddr *)&peer, &len) == 0)
+		{
+			return 0;
+		}
+		if(errno != ENOTCONN || netpoll_wait(desc, NETPOLL_WRITE))
+		{
+			return -1;
+		}
+	}
+}
+
+/**
+ * @brief Close a file descriptor, and wake up the threads still waiting on it
+ *
+ * @param fd File descriptor to close
+ * @return int - 0 in case of success, -1 in case of failure
+ */
+int uthread_close(int fd)
+{
+	struct uthread_tcb *woken[2] = { NULL, NULL };
+	struct netpoll_desc *desc = NULL;
+	int ret;
+
+	if(fd >= 0)
+	{
+		preempt_disable();
+		spin_lock(&tableLock);
+		desc = desc_lookup(fd, false);
+		spin_unlock(&tableLock);
+
+		if(desc)
+		{
+			spin_lock(&desc->lock);
+			if(desc->registered)
+			{
+				epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, NULL);
+			}
+			desc->registered = false;
+			desc->unpollable = false;
+			for(int mode = NETPOLL_READ; mode <= NETPOLL_WRITE; mode++)
+			{
+				desc->ready[mode] = false;
+				woken[mode] = desc->waiter[mode];
+				desc->waiter[mode] = NULL;
+				if(woken[mode])
+				{
+					__atomic_sub_fetch(&waiters, 1, __ATOMIC_SEQ_CST);
+				}
+			}
+			__atomic_add_fetch(&desc->gen, 1, __ATOMIC_RELAXED);
+			spin_unlock(&desc->lock);
+		}
+		preempt_enable();
+	}
+
+	ret = close(fd);
+
+	for(int mode = NETPOLL_READ; mode <= NETPOLL_WRITE; mode++)
+	{
+		if(woken[mode])
+		{
+			uthread_unblock(woken[mode]);
+		}
+	}
+
+	return ret;
+}
@@ -0,0 +1,111 @@
+#ifndef _NETPOLL_H
+#define _NETPOLL_H
+
+#include <stdbool.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+
+/*
+ * Thread-blocking I/O
+ *
+ * The functions below behave like the system calls they are named after, but
+ * only block the calling thread instead of the kernel thread running it. The
+ * file descriptor is registered with the library's poller and switched to
+ * non-blocking mode on first use (which affects every descriptor sharing its
+ * open file description); whenever the call would block, the calling thread
+ * waits for the file descriptor to become ready while other threads run. A
+ * worker left with nothing to run blocks in the poller.
+ *
+ * Only one thread can wait to read from a file descriptor, and one to write to
+ * it, at a time. Called from outside of a thread, these functions block the
+ * calling kernel thread. File descriptors that cannot be polled, like regular
+ * files, are read and written through io_uring if enabled, or on a helper
+ * kernel thread otherwise.
+ *
+ * A file descriptor used with these functions must be closed with
+ * uthread_close(), so that the poller forgets it before its number is reused.
+ */
+
+/*
+ * uthread_set_io_uring - Enable or disable io_uring
+ * @enable: Whether to enable io_uring
+ *
+ * With io_uring enabled, reads and writes of file descriptors that cannot be
+ * polled, like regular files, no longer block the kernel thread: the calling
+ * thread queues its request in the ring and blocks until it completes. The
+ * requests threads queue are submitted together, with a single system call,
+ * once enough of them are queued, or when a worker runs out of threads to run.
+ * Like with read() and write(), files are read and written at their current
+ * position.
+ *
+ * io_uring is disabled by default. Without it, or for requests that do not fit
+ * in the ring, these reads and writes are made through uthread_offload()
+ * instead.
+ *
+ * Return: 0 in case of success, or -1 if io_uring is unavailable, in which
+ * case file descriptors are used as if it was disabled
+ */
+int uthread_set_io_uring(bool enable);
+
+/*
+ * uthread_read - Read from a file descriptor
+ * @fd: File descriptor to read from
+ * @buf: Buffer to read into
+ * @count: Maximum number of bytes to read
+ *
+ * File descriptors that cannot be polled, like regular files, are read through
+ * io_uring if enabled (see uthread_set_io_uring()), or uthread_offload().
+ *
+ * Return: Number of bytes read, 0 at end of file, or -1 in case of failure,
+ * with errno set (EBUSY if another thread is already waiting to read from @fd)
+ */
+ssize_t uthread_read(int fd, void *buf, size_t count);
+
+/*
+ * uthread_write - Write to a file descriptor
+ * @fd: File descriptor to write to
+ * @buf: Buffer to write from
+ * @count: Number of bytes to write
+ *
+ * Like write(), may write fewer than @count bytes. File descriptors that cannot
+ * be polled are written like uthread_read() reads them.
+ *
+ * Return: Number of bytes written, or -1 in case of failure, with errno set
+ * (EBUSY if another thread is already waiting to write to @fd)
+ */
+ssize_t uthread_write(int fd, const void *buf, size_t count);
+
+/*
+ * uthread_accept - Accept a connection on a socket
+ * @sockfd: Listening socket
+ * @addr: Set to the address of the peer if not NULL
+ * @addrlen: Size of @addr, set to the size of the address of the peer
+ *
+ * The new socket is non-blocking, ready to be used with these functions.
+ *
+ * Return: File descriptor of the new socket, or -1 in case of failure, with
+ * errno set
+ */
+int uthread_accept(int sockfd, struct sockaddr *addr, socklen_t *addrlen);
+
+/*
+ * uthread_connect - Connect a socket
+ * @sockfd: Socket to connect
+ * @addr: Address to connect to
+ * @addrlen: Size of @addr
+ *
+ * Return: 0 once connected, or -1 in case of failure, with errno set
+ */
+int uthread_connect(int sockfd, const struct sockaddr *addr, socklen_t addrlen);
+
+/*
+ * uthread_close - Close a file descriptor
+ * @fd: File descriptor to close
+ *
+ * Threads still waiting on @fd are woken up, and fail with EBADF.
+ *
+ * Return: 0 in case of success, or -1 in case of failure, with errno set
+ */
+int uthread_close(int fd);
+
+#endif /* _NETPOLL_H */
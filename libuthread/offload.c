@@ -0,0 +1,160 @@
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "private.h"
+#include "uthread.h"
+
+/* Number of helper kernel threads, started on first use */
+#define OFFLOAD_THREADS 4
+
+/*
+ * Call offloaded by a thread, on its stack. Once it is done, msg is posted to
+ * the scheduler's inbox to unblock the thread.
+ */
+struct offload_req
+{
+	void *(*func)(void *);
+	void *arg;
+	void *result;
+	struct inbox_msg msg;
+	struct offload_req *next;
+};
+
+/*
+ * Calls waiting for a helper, in FIFO order, protected by queueLock, and
+ * whether the helpers were started
+ */
+static pthread_mutex_t queueLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queueCond = PTHREAD_COND_INITIALIZER;
+static struct offload_req *queueHead, *queueTail;
+static bool started;
+
+/**
+ * @brief Main function of a helper kernel thread: run offloaded calls, and
+ * hand them back to the scheduler
+ *
+ * @param arg Unused
+ * @return none, never returns
+ */
+static void *offload_main(void *arg)
+{
+	sigset_t all;
+	(void)arg;
+
+	/* Signals are left to the workers and the rest of the program */
+	sigfillset(&all);
+	pthread_sigmask(SIG_BLOCK, &all, NULL);
+
+	while(true)
+	{
+		pthread_mutex_lock(&queueLock);
+		while(queueHead == NULL)
+		{
+			pthread_cond_wait(&queueCond, &queueLock);
+		}
+
+		struct offload_req *req = queueHead;
+
+		queueHead = req->next;
+		if(queueHead == NULL)
+		{
+			queueTail = NULL;
+		}
+		pthread_mutex_unlock(&queueLock);
+
+		req->result = req->func(req->arg);
+
+		/* The run goes on at least until the inbox is drained */
+		inbox_post(&req->msg);
+		uthread_external_release();
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Start the helper kernel threads, queueLock must be held
+ *
+ * @param none
+ * @return Returns 0 if at least one helper runs, -1 otherwise
+ */
+static int offload_start(void)
+{
+	pthread_attr_t attr;
+	int count = 0;
+
+	if(started)
+	{
+		return 0;
+	}
+
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	for(int i = 0; i < OFFLOAD_THREADS; i++)
+	{
+		pthread_t helper;
+
+		if(pthread_create(&helper, &attr, offload_main, NULL) == 0)
+		{
+			count++;
+		}
+	}
+	pthread_attr_destroy(&attr);
+
+	started = count > 0;
+	return started ? 0 : -1;
+}
+
+/**
+ * @brief Run a function that blocks on a helper kernel thread, blocking only
+ * the calling thread until it returns
+ *
+ * @param func Function to run
+ * @param arg Argument of @func
+ * @return void* - Value returned by @func
+ */
+void *uthread_offload(void *(*func)(void *), void *arg)
+{
+	struct offload_req req = {
+		.func = func,
+		.arg = arg,
+		.msg = { .type = INBOX_UNBLOCK },
+	};
+
+	preempt_disable();
+	req.msg.thread = uthread_current();
+
+	/* Outside of a thread, there is no scheduler to keep going */
+	if(req.msg.thread == NULL)
+	{
+		preempt_enable();
+		return func(arg);
+	}
+
+	pthread_mutex_lock(&queueLock);
+	if(offload_start())
+	{
+		pthread_mutex_unlock(&queueLock);
+		preempt_enable();
+		return func(arg);
+	}
+
+	if(queueTail)
+	{
+		queueTail->next = &req;
+	}
+	else
+	{
+		queueHead = &req;
+	}
+	queueTail = &req;
+	uthread_external_hold();
+	pthread_cond_signal(&queueCond);
+	pthread_mutex_unlock(&queueLock);
+
+	uthread_block();
+
+	return req.result;
+}
@@ -1,29 +1,75 @@
+#include <pthread.h>
 #include <signal.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <sys/time.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "private.h"
+#include "spinlock.h"
 #include "uthread.h"
 
 /*
- * Frequency of preemption
- * 100Hz is 100 times per second
+ * Default time slice (in microseconds)
+ * 10 ms is 100 times per second
  */
-#define HZ 100
+#define QUANTUM_DEFAULT 10000
+
+/* Not defined by older C libraries */
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
 
 /* Handlers for virtual alarm */
 struct sigaction newHandler;
 struct sigaction oldHandler;
-sigset_t ss;
 
-/* Timers to raise periodic SIGVTALRM */
-struct itimerval newValue;
-struct itimerval oldValue;
-int timerType;
+/* Time slice, and clock measuring it */
+static unsigned long preemptQuantum = QUANTUM_DEFAULT;
+static uthread_clock_t preemptClock = UTHREAD_CLOCK_CPU;
+
+/* Set from preempt_start() to preempt_stop() */
+static bool preemptActive;
+
+/*
+ * Each kernel thread running threads has its own timer, which only signals
+ * that kernel thread. The timers are chained so that preempt_stop() can disarm
+ * all of them.
+ *
+ * Timers are one-shot, and only armed while some other thread is ready to run
+ * (see preempt_tick()): there is no point in interrupting a thread that would
+ * get the CPU right back.
+ */
+struct preempt_timer
+{
+	timer_t id;
+	bool created;
+	volatile bool armed;
+
+	/* Monotonic time (in ns) at which the armed timer is due */
+	uint64_t expiry;
+
+	struct preempt_timer *next;
+};
+
+static __thread struct preempt_timer threadTimer;
+static struct preempt_timer *timers;
+static spinlock_t timersLock;
+
+/*
+ * Preemption is disabled by setting a flag of the calling kernel thread, with
+ * no system call. An alarm that fires while the flag is set only records that a
+ * yield is pending, and the yield happens as soon as preemption is enabled.
+ * Both flags share a word, so that preempt_enable() clears them in a single
+ * step that the alarm cannot come in the middle of.
+ */
+#define PREEMPT_DISABLED 1
+#define PREEMPT_PENDING 2
+static __thread volatile sig_atomic_t preemptState;
 
 /**
  * @brief Signal handler for SIGVTALRM, yields to next available thread
@@ -33,11 +79,21 @@ int timerType;
  */
 void preempt_handler(int signum)
 {
-	/* Force currently running thread to yield */
-	if(signum)
+	(void)signum;
+
+	/* One-shot timer, the scheduler decides whether to rearm it */
+	threadTimer.armed = false;
+
+	/* Yield later if the thread is in a critical section */
+	if(preemptState & PREEMPT_DISABLED)
 	{
-		uthread_yield(); 
+		preemptState = PREEMPT_DISABLED | PREEMPT_PENDING;
+		return;
 	}
+
+	/* Force currently running thread to yield */
+	preemptState = PREEMPT_DISABLED;
+	uthread_preempt();
 }
 
 /**
@@ -48,9 +104,12 @@ void preempt_handler(int signum)
  */
 void preempt_disable(void)
 {
-	/* Add SIGVTALRM to blocked signals */	
-	sigaddset(&ss, SIGVTALRM);
-	sigprocmask(SIG_BLOCK, &ss, NULL);
+	/* A yield is only pending while disabled, keep it if already disabled */
+	if(!(preemptState & PREEMPT_DISABLED))
+	{
+		preemptState = PREEMPT_DISABLED;
+	}
+	__atomic_signal_fence(__ATOMIC_SEQ_CST);
 }
 
 /**
@@ -61,14 +120,51 @@ void preempt_disable(void)
  */
 void preempt_enable(void)
 {
-	/* Remove SIGVTALRM from blocked signals */
-	sigemptyset(&ss);
-	sigaddset(&ss, SIGVTALRM);
-	sigprocmask(SIG_UNBLOCK, &ss, NULL);
+	sig_atomic_t disabled = PREEMPT_DISABLED;
+
+	__atomic_signal_fence(__ATOMIC_SEQ_CST);
+
+	/* From then on, an alarm preempts the thread right away */
+	if(__atomic_compare_exchange_n(&preemptState, &disabled, 0, false,
+				       __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+	{
+		return;
+	}
+
+	/*
+	 * Catch up with the alarm that fired while preemption was disabled, still
+	 * disabled so that another alarm cannot preempt the thread meanwhile and
+	 * have it yield twice; the yield enables preemption once done
+	 */
+	if(preemptState & PREEMPT_PENDING)
+	{
+		preemptState = PREEMPT_DISABLED;
+		uthread_preempt();
+	}
 }
 
 /**
- * @brief Start thread preemption, create a timer that raises SIGVTALRM every 100Hz
+ * @brief Configure the time slice of preemption
+ *
+ * @param quantum_us Time slice, in microseconds
+ * @param clock Clock measuring the time slice
+ * @return Returns 0 in case of success, -1 if @quantum_us or @clock is invalid
+ */
+int uthread_set_preemption(unsigned long quantum_us, uthread_clock_t clock)
+{
+	if(quantum_us == 0 ||
+	   (clock != UTHREAD_CLOCK_CPU && clock != UTHREAD_CLOCK_MONOTONIC))
+	{
+		return -1;
+	}
+
+	preemptQuantum = quantum_us;
+	preemptClock = clock;
+	return 0;
+}
+
+/**
+ * @brief Start thread preemption, install the SIGVTALRM handler
  *
  * @param preempt Enable preemption if true
  * @return none
@@ -83,34 +179,213 @@ void preempt_start(bool preempt)
 
 	newHandler.sa_handler = preempt_handler; /* Add signal handler */
 	sigemptyset(&newHandler.sa_mask); /* Initialize blocked signals */
-	newHandler.sa_flags = 0; /* No special behavior for signal */
+
+	/*
+	 * Don't block SIGVTALRM while the handler runs: it yields, and the thread
+	 * switched to must stay preemptible until the handler returns, which may
+	 * be much later. The preemption flag keeps the handler from nesting.
+	 */
+	newHandler.sa_flags = SA_NODEFER;
 	sigaction(SIGVTALRM, &newHandler, &oldHandler); /* Initialize sigaction to listen for SIGVTALRM */
 
-	/* Set interval timer type to decrement by process execution time */
-	/* Raises SIGVTALRM after every interval */
-	timerType = ITIMER_VIRTUAL;
+	preemptActive = true;
+}
 
-	/* Set time to expire after 100Hz... */
-	newValue.it_value.tv_sec = 0; 
-	newValue.it_value.tv_usec = 100 * HZ;
+/**
+ * @brief Start the timer of the calling kernel thread, which raises SIGVTALRM
+ * at the end of every time slice
+ *
+ * @param none
+ * @return none
+ */
+void preempt_thread_start(void)
+{
+	struct sigevent sev = { 0 };
+	clockid_t clock = preemptClock == UTHREAD_CLOCK_MONOTONIC ?
+		CLOCK_MONOTONIC : CLOCK_THREAD_CPUTIME_ID;
 
-	/* ...and every 100HZ after that */
-	newValue.it_interval.tv_sec = 0;       
-    newValue.it_interval.tv_usec = 100 * HZ;
+	if(!preemptActive)
+	{
+		return;
+	}
 
-	/* Start internal timer */
-	setitimer(timerType, &newValue, &oldValue);
+	/* Signal this kernel thread only */
+	sev.sigev_notify = SIGEV_THREAD_ID;
+	sev.sigev_signo = SIGVTALRM;
+	sev.sigev_notify_thread_id = syscall(SYS_gettid);
+	if(timer_create(clock, &sev, &threadTimer.id))
+	{
+		return;
+	}
+	threadTimer.created = true;
+	threadTimer.armed = false;
+
+	spin_lock(&timersLock);
+	threadTimer.next = timers;
+	timers = &threadTimer;
+	spin_unlock(&timersLock);
 }
 
 /**
- * @brief Stop thread preemption, restore previous timer and sigaction configurations
+ * @brief Get the time, to compare with release times of the scheduler
+ *
+ * @param none
+ * @return Monotonic time, in nanoseconds
+ */
+static uint64_t preempt_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * @brief Arm the timer of the calling kernel thread for a whole time slice, or
+ * disarm it
+ *
+ * @param needed True to arm the timer
+ * @return none
+ */
+static void preempt_arm(bool needed)
+{
+	struct itimerspec slice = { 0 };
+
+	/* Expire once, after a time slice */
+	if(needed)
+	{
+		slice.it_value.tv_sec = preemptQuantum / 1000000;
+		slice.it_value.tv_nsec = preemptQuantum % 1000000 * 1000;
+		threadTimer.expiry = preempt_now() + preemptQuantum * 1000;
+	}
+
+	threadTimer.armed = needed;
+	timer_settime(threadTimer.id, 0, &slice, NULL);
+}
+
+/**
+ * @brief Arm or disarm the timer of the calling kernel thread, preemption
+ * must be disabled
+ *
+ * @param needed True if some other thread is ready to run
+ * @return none
+ */
+void preempt_tick(bool needed)
+{
+	/* Only make a system call when the state changes */
+	if(!preemptActive || !threadTimer.created || threadTimer.armed == needed)
+	{
+		return;
+	}
+
+	preempt_arm(needed);
+}
+
+/**
+ * @brief Start a new time slice on the timer of the calling kernel thread, or
+ * disarm it, preemption must be disabled
+ *
+ * @param needed True if some other thread is ready to run
+ * @return none
+ */
+void preempt_restart(bool needed)
+{
+	if(!preemptActive || !threadTimer.created ||
+	   (!needed && !threadTimer.armed))
+	{
+		return;
+	}
+
+	preempt_arm(needed);
+}
+
+/**
+ * @brief Make sure the timer of the calling kernel thread fires by a given
+ * time, preemption must be disabled
+ *
+ * @param when Monotonic time, in nanoseconds
+ * @return none
+ */
+void preempt_release(uint64_t when)
+{
+	struct itimerspec delay = { 0 };
+
+	/* Only make a system call if the timer would fire too late */
+	if(!preemptActive || !threadTimer.created ||
+	   (threadTimer.armed && threadTimer.expiry <= when))
+	{
+		return;
+	}
+
+	/* A zero delay would disarm the timer */
+	uint64_t now = preempt_now();
+	uint64_t ns = when > now ? when - now : 1;
+	delay.it_value.tv_sec = ns / 1000000000;
+	delay.it_value.tv_nsec = ns % 1000000000;
+
+	threadTimer.armed = true;
+	threadTimer.expiry = when;
+	timer_settime(threadTimer.id, 0, &delay, NULL);
+}
+
+/**
+ * @brief Delete the timer of the calling kernel thread
+ *
+ * @param none
+ * @return none
+ */
+void preempt_thread_stop(void)
+{
+	if(!threadTimer.created)
+	{
+		return;
+	}
+
+	spin_lock(&timersLock);
+	struct preempt_timer **link = &timers;
+	while(*link != &threadTimer)
+	{
+		link = &(*link)->next;
+	}
+	*link = threadTimer.next;
+	spin_unlock(&timersLock);
+
+	timer_delete(threadTimer.id);
+	threadTimer.created = false;
+}
+
+/**
+ * @brief Stop thread preemption, disarm all the timers and restore previous
+ * sigaction configuration
  *
  * @param none
  * @return none
  */
 void preempt_stop(void)
 {
-	/* Restore previous sigaction and timer configurations */
+	struct itimerspec disarm = { 0 };
+	sigset_t alarm, mask;
+
+	if(!preemptActive)
+	{
+		return;
+	}
+	preemptActive = false;
+
+	/* This may be called with preemption enabled, keep the alarm out */
+	sigemptyset(&alarm);
+	sigaddset(&alarm, SIGVTALRM);
+	pthread_sigmask(SIG_BLOCK, &alarm, &mask);
+
+	spin_lock(&timersLock);
+	for(struct preempt_timer *timer = timers; timer; timer = timer->next)
+	{
+		timer_settime(timer->id, 0, &disarm, NULL);
+	}
+	spin_unlock(&timersLock);
+
+	pthread_sigmask(SIG_SETMASK, &mask, NULL);
+
+	/* Restore previous sigaction configuration */
 	sigaction(SIGVTALRM, &oldHandler, NULL);
-	setitimer(timerType, &oldValue, NULL);
-}
\ No newline at end of file
+}
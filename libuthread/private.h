@@ -10,10 +10,29 @@
 /**
  * Private context API
  */
-#include <ucontext.h>
+#include <stddef.h>
+#include <stdint.h>
 
+#include "list.h"
 #include "uthread.h"
 
+/*
+ * Context switch backend
+ *
+ * On x86-64 and aarch64, contexts are switched by a small assembly routine
+ * that only saves the callee-saved registers and the stack pointer. Building
+ * with UTHREAD_CTX_UCONTEXT defined (`make CTX=ucontext`), or for any other
+ * architecture, falls back to the portable ucontext implementation.
+ */
+#if defined(UTHREAD_CTX_UCONTEXT) || \
+	!(defined(__x86_64__) || defined(__aarch64__))
+#define UTHREAD_CTX_BACKEND "ucontext"
+#include <ucontext.h>
+#else
+#define UTHREAD_CTX_ASM
+#define UTHREAD_CTX_BACKEND "asm"
+#endif
+
 /*
  * uthread_ctx_t - User-level thread context
  *
@@ -23,42 +42,80 @@
  * Such a context is initialized for the first time when creating a thread with
  * uthread_ctx_init(). Once initialized, it can be switched to with
  * uthread_ctx_switch().
+ *
+ * With the assembly backend, the callee-saved registers live on the thread's
+ * own stack and the context only records where that stack was left.
  */
+#ifdef UTHREAD_CTX_ASM
+typedef struct uthread_ctx {
+	void *sp;
+} uthread_ctx_t;
+#else
 typedef ucontext_t uthread_ctx_t;
+#endif
 
 /*
  * uthread_ctx_switch - Switch between two execution contexts
  * @prev: Pointer to the execution context structure in which to save the
  *	currently running thread
  * @next: Pointer to the execution context structure to resume
+ *
+ * The switch does not change the preemption state: the caller disables
+ * preemption before switching, and whichever thread resumes re-enables it.
  */
 void uthread_ctx_switch(uthread_ctx_t *prev, uthread_ctx_t *next);
 
+/* Default size of the stack for a thread (in bytes) */
+#define UTHREAD_STACK_SIZE 32768
+
 /*
  * uthread_ctx_alloc_stack - Allocate stack segment
+ * @size: Size of the stack segment (in bytes)
+ * @guard: Size of the inaccessible guard area below the stack segment (in
+ *	bytes), or 0 for no guard area
+ *
+ * The stack segment is only backed by memory as it gets used. Stacks are rounded
+ * up to a power-of-two size class and taken from a pool of stacks released by
+ * exited threads when possible.
+ *
+ * The stack pool is shared by all the kernel threads running the scheduler, and
+ * must only be used with preemption disabled.
  *
  * Return: Pointer to the top of a valid stack segment, or NULL in case of
  * failure
  */
-void *uthread_ctx_alloc_stack(void);
+void *uthread_ctx_alloc_stack(size_t size, size_t guard);
 
 /*
  * uthread_ctx_destroy_stack - Deallocate stack segment
  * @top_of_stack: Address of stack to deallocate
+ * @size: Size the stack segment was allocated with
+ * @guard: Size of the guard area the stack segment was allocated with
+ *
+ * The stack segment is returned to the stack pool for later reuse.
+ * Preemption must be disabled.
+ */
+void uthread_ctx_destroy_stack(void *top_of_stack, size_t size, size_t guard);
+
+/*
+ * uthread_ctx_release_stacks - Empty the stack pool
+ *
+ * Give back the memory of every idle stack held by the stack pool.
  */
-void uthread_ctx_destroy_stack(void *top_of_stack);
+void uthread_ctx_release_stacks(void);
 
 /*
  * uthread_ctx_init - Initialize a thread's execution context
  * @uctx: Pointer to thread context to initialize
  * @top_of_stack: Pointer to the top of a valid stack segment, as allocated by
  *	uthread_ctx_alloc_stack()
+ * @size: Size the stack segment was allocated with
  * @func: Function to be executed by the thread
  * @arg: Argument to pass to the thread
  *
  * Return: 0 if @uctx was properly initialized, or -1 in case of failure
  */
-int uthread_ctx_init(uthread_ctx_t *uctx, void *top_of_stack,
+int uthread_ctx_init(uthread_ctx_t *uctx, void *top_of_stack, size_t size,
 					 uthread_func_t func, void *arg);
 
 
@@ -70,33 +127,370 @@ int uthread_ctx_init(uthread_ctx_t *uctx, void *top_of_stack,
  * preempt_start - Start thread preemption
  * @preempt: Enable preemption if true
  *
- * Configure a timer that must fire a virtual alarm at a frequency of 100 Hz and
- * setup a timer handler that forcefully yields the currently running thread.
+ * Setup a virtual alarm handler that forcefully yields the currently running
+ * thread. The alarms are raised by per kernel thread timers, created with
+ * preempt_thread_start(), at the end of the time slice configured with
+ * uthread_set_preemption().
  *
  * If @preempt is false, don't start preemption; all the other functions from
  * the preemption API should then be ineffective.
  */
 void preempt_start(bool preempt);
 
+/*
+ * preempt_thread_start - Create the preemption timer of the calling kernel
+ * thread
+ *
+ * Create a timer that fires a virtual alarm at the calling kernel thread only,
+ * once armed with preempt_tick(). Does nothing if preemption was not started.
+ */
+void preempt_thread_start(void);
+
+/*
+ * preempt_tick - Arm or disarm the preemption timer of the calling kernel thread
+ * @needed: Whether the running thread may have to be preempted
+ *
+ * The scheduler calls this whenever it finds out whether threads other than
+ * the running one are ready to run. If @needed is true and the timer is not
+ * armed, it is armed to fire once at the end of a time slice; if @needed is
+ * false, the timer is disarmed. Only changes of state cost a system call.
+ * Preemption must be disabled.
+ */
+void preempt_tick(bool needed);
+
+/*
+ * preempt_restart - Start a new time slice
+ * @needed: Whether the running thread may have to be preempted
+ *
+ * Same as preempt_tick(), except that if @needed is true, the timer is armed
+ * for a whole time slice even if it was already armed. This costs a system
+ * call every time. Preemption must be disabled.
+ */
+void preempt_restart(bool needed);
+
+/*
+ * preempt_release - Make sure the running thread is interrupted in time for a
+ * thread to become ready
+ * @when: CLOCK_MONOTONIC time (in ns) at which the thread becomes ready
+ *
+ * Arm the timer of the calling kernel thread to fire at @when, unless it is
+ * armed to fire earlier. With UTHREAD_CLOCK_CPU, the timer counts the CPU time
+ * of the kernel thread, so it only fires on time if the kernel thread is not
+ * kept off the CPU. Preemption must be disabled.
+ */
+void preempt_release(uint64_t when);
+
+/*
+ * preempt_thread_stop - Delete the preemption timer of the calling kernel thread
+ */
+void preempt_thread_stop(void);
+
 /*
  * preempt_stop - Stop thread preemption
  *
- * Restore previous timer configuration, and previous action associated to
- * virtual alarm signals.
+ * Disarm the timers of all the kernel threads, and restore previous action
+ * associated to virtual alarm signals.
  */
 void preempt_stop(void);
 
 /*
  * preempt_enable - Enable preemption
+ *
+ * Preemption is enabled and disabled for the calling kernel thread only, and
+ * calls do not nest. If the timer fired while preemption was disabled, the
+ * current thread yields right away.
  */
 void preempt_enable(void);
 
 /*
  * preempt_disable - Disable preemption
+ *
+ * Only sets a flag, so it is cheap enough to be called around every scheduler
+ * operation.
  */
 void preempt_disable(void);
 
 
+/**
+ * Private slab API
+ */
+
+/*
+ * slab_t - Object cache type
+ *
+ * A slab cache hands out objects of a single size carved from large memory
+ * chunks, and keeps freed objects for reuse. Allocating and freeing an object
+ * are O(1) and never return memory to the system; all the memory of a cache is
+ * freed at once when destroying it.
+ */
+typedef struct slab_cache *slab_t;
+
+/*
+ * slab_create - Create an object cache
+ * @size: Size of the objects (in bytes)
+ * @align: Alignment of the objects (in bytes), must be a power of two
+ *
+ * Return: Pointer to new empty cache. NULL in case of failure.
+ */
+slab_t slab_create(size_t size, size_t align);
+
+/*
+ * slab_alloc - Allocate an object
+ * @cache: Cache to allocate the object from
+ *
+ * Return: Pointer to an uninitialized object, or NULL in case of failure
+ */
+void *slab_alloc(slab_t cache);
+
+/*
+ * slab_free - Free an object
+ * @cache: Cache the object was allocated from
+ * @obj: Object to free
+ */
+void slab_free(slab_t cache, void *obj);
+
+/*
+ * slab_destroy - Destroy an object cache
+ * @cache: Cache to destroy
+ *
+ * Free all the memory of @cache, including objects that were not freed yet.
+ */
+void slab_destroy(slab_t cache);
+
+
+/**
+ * Private deque API
+ */
+
+/*
+ * struct deque - Work-stealing deque
+ *
+ * A Chase-Lev deque of non-NULL pointers, owned by a single kernel thread. The
+ * owner pushes and takes items at the bottom, in LIFO order, while any other
+ * kernel thread can steal items from the top, in FIFO order, without locking.
+ * The array holding the items doubles when full; the arrays it outgrew are only
+ * freed when destroying the deque, as thieves may still be reading them.
+ */
+struct deque_array;
+
+struct deque {
+	long top;
+	long bottom;
+	struct deque_array *array;
+};
+
+/*
+ * deque_init - Initialize an empty deque
+ * @deque: Deque to initialize
+ *
+ * Return: 0 if @deque was initialized, -1 in case of memory allocation error
+ */
+int deque_init(struct deque *deque);
+
+/*
+ * deque_destroy - Free the memory of a deque
+ * @deque: Deque to destroy, which must not be used anymore
+ */
+void deque_destroy(struct deque *deque);
+
+/*
+ * deque_push - Push an item at the bottom of a deque
+ * @deque: Deque owned by the calling kernel thread
+ * @item: Item to push
+ *
+ * Return: 0 if @item was pushed, -1 in case of memory allocation error
+ */
+int deque_push(struct deque *deque, void *item);
+
+/*
+ * deque_take - Take the item at the bottom of a deque
+ * @deque: Deque owned by the calling kernel thread
+ *
+ * Return: Most recently pushed item, or NULL if @deque is empty
+ */
+void *deque_take(struct deque *deque);
+
+/*
+ * deque_steal - Steal the item at the top of a deque
+ * @deque: Deque owned by another kernel thread
+ *
+ * Return: Least recently pushed item, or NULL if @deque is empty or if another
+ * kernel thread took the item first
+ */
+void *deque_steal(struct deque *deque);
+
+/*
+ * deque_empty - Check whether a deque looks empty
+ * @deque: Deque to check
+ */
+bool deque_empty(struct deque *deque);
+
+
+/**
+ * Private heap API
+ */
+
+/*
+ * struct heap - Binary min-heap
+ *
+ * A priority queue of pointers ordered by a 64-bit key, used by the scheduler
+ * to queue threads by virtual runtime or by deadline. Items of equal keys come
+ * out in the order they were inserted. Pushing never allocates memory: room
+ * for an item must be reserved beforehand with heap_reserve(), e.g. when the
+ * thread to be queued is created. Heaps are not thread-safe.
+ */
+struct heap_entry {
+	uint64_t key;
+	uint64_t seq;
+	void *item;
+};
+
+struct heap {
+	struct heap_entry *entries;
+	size_t length;
+	size_t capacity;
+	size_t reserved;
+	uint64_t seq;
+};
+
+/*
+ * heap_init - Initialize an empty heap
+ * @heap: Heap to initialize
+ * @size: Number of items the heap can hold at first, not 0
+ *
+ * Return: 0 if @heap was initialized, -1 in case of memory allocation error
+ */
+int heap_init(struct heap *heap, size_t size);
+
+/*
+ * heap_destroy - Free the memory of a heap
+ * @heap: Heap to destroy, which must not be used anymore
+ */
+void heap_destroy(struct heap *heap);
+
+/*
+ * heap_reserve - Reserve room for one more item
+ * @heap: Heap to reserve room in
+ *
+ * Return: 0 in case of success, -1 in case of memory allocation error
+ */
+int heap_reserve(struct heap *heap);
+
+/*
+ * heap_unreserve - Give back the room reserved for one item
+ * @heap: Heap the room was reserved in
+ */
+void heap_unreserve(struct heap *heap);
+
+/*
+ * heap_push - Insert an item
+ * @heap: Heap to insert @item in, with room reserved for it
+ * @key: Key of @item
+ * @item: Item to insert
+ */
+void heap_push(struct heap *heap, uint64_t key, void *item);
+
+/*
+ * heap_pop - Remove the item with the lowest key
+ * @heap: Heap to remove the item from
+ * @key: Set to the key of the item if not NULL
+ *
+ * Return: Item with the lowest key, the oldest one among equal keys, or NULL if
+ * @heap is empty
+ */
+void *heap_pop(struct heap *heap, uint64_t *key);
+
+/*
+ * heap_min - Get the lowest key
+ * @heap: Heap to look into
+ * @key: Set to the lowest key
+ *
+ * Return: true if @heap is not empty, false otherwise
+ */
+bool heap_min(const struct heap *heap, uint64_t *key);
+
+
+/**
+ * Private timing wheel API
+ */
+
+/*
+ * struct wheel - Hierarchical timing wheel
+ *
+ * Timers are kept in WHEEL_LEVELS levels of WHEEL_SLOTS slots each. A slot of
+ * level 0 holds the timers expiring on one tick, and a slot of level i the
+ * timers expiring within WHEEL_SLOTS^i ticks; as time goes by, the slots of
+ * the upper levels are cascaded down to the lower ones, until their timers
+ * expire from level 0. Slots are intrusive lists, and each level has a bitmap
+ * of its non-empty slots, so that adding and cancelling a timer are O(1), and
+ * finding the next tick at which something happens is O(WHEEL_LEVELS), however
+ * many timers there are. Timers further away than the wheel spans wait in its
+ * last slot and are cascaded again.
+ *
+ * Times are CLOCK_MONOTONIC times in ns, and a tick lasts 2^WHEEL_TICK_SHIFT
+ * ns (about 131 us). Timers never expire early, but may expire up to a tick
+ * late. Wheels are not thread-safe.
+ */
+#define WHEEL_TICK_SHIFT 17
+#define WHEEL_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_LEVELS 6
+
+struct wheel_timer {
+	struct list_node link;
+	uint64_t expiry;
+	struct list *slot;
+};
+
+struct wheel {
+	struct list slots[WHEEL_LEVELS][WHEEL_SLOTS];
+	uint64_t occupied[WHEEL_LEVELS];
+	uint64_t now;
+	size_t length;
+};
+
+/*
+ * wheel_init - Initialize an empty timing wheel
+ * @wheel: Wheel to initialize
+ * @now: Current time (in ns)
+ */
+void wheel_init(struct wheel *wheel, uint64_t now);
+
+/*
+ * wheel_add - Arm a timer
+ * @wheel: Wheel to add @timer to
+ * @timer: Timer, which must not be armed already
+ * @when: Time at which @timer expires (in ns), a time already past expires on
+ *	the next tick
+ */
+void wheel_add(struct wheel *wheel, struct wheel_timer *timer, uint64_t when);
+
+/*
+ * wheel_cancel - Disarm a timer
+ * @wheel: Wheel @timer was added to
+ * @timer: Timer to disarm, which may have expired already
+ */
+void wheel_cancel(struct wheel *wheel, struct wheel_timer *timer);
+
+/*
+ * wheel_advance - Move time forward and collect the timers that expired
+ * @wheel: Wheel to advance
+ * @now: Current time (in ns)
+ * @expired: List the timers expired by @now are moved to, through their link
+ *	member
+ */
+void wheel_advance(struct wheel *wheel, uint64_t now, struct list *expired);
+
+/*
+ * wheel_next - Get the time at which a wheel next needs advancing
+ * @wheel: Wheel to look into
+ * @when: Set to the time (in ns) at which the next timer expires, or earlier
+ *	when some timer needs to be cascaded first
+ *
+ * Return: true if @wheel holds timers, false otherwise
+ */
+bool wheel_next(const struct wheel *wheel, uint64_t *when);
+
 /**
  * Private uthread API
  */
@@ -114,8 +508,23 @@ struct uthread_tcb;
  */
 struct uthread_tcb *uthread_current(void);
 
+/*
+ * uthread_preempt - Preempt currently running thread
+ *
+ * Same as uthread_yield(), for a thread that used up its time slice, which the
+ * scheduling policy may hold against it.
+ */
+void uthread_preempt(void);
+
 /*
  * uthread_block - Block currently running thread
+ *
+ * The caller must have disabled preemption and registered the current thread
+ * somewhere it will be unblocked from, e.g. the waiting queue of a semaphore.
+ * The thread is unblocked exactly once per call, possibly by another kernel
+ * thread before it even gets to call uthread_block().
+ *
+ * Returns with preemption enabled, once the thread has been unblocked.
  */
 void uthread_block(void);
 
@@ -125,4 +534,254 @@ void uthread_block(void);
  */
 void uthread_unblock(struct uthread_tcb *uthread);
 
+/*
+ * uthread_unblock_handoff - Unblock thread and switch to it right away
+ * @uthread: TCB of thread to unblock
+ *
+ * Same as uthread_unblock(), but if @uthread is done blocking and comes before
+ * the current thread, the current thread is made ready and the worker switches
+ * straight to @uthread, without going through the run queue. Otherwise, and
+ * with the fair policy, which orders threads by virtual runtime only, @uthread
+ * is simply made ready.
+ */
+void uthread_unblock_handoff(struct uthread_tcb *uthread);
+
+/*
+ * uthread_switch_finish - Complete a context switch
+ *
+ * Must be called by every thread right after it is switched to, including by
+ * a new thread the first time it runs, to let the scheduler release the
+ * thread that was switched from, or free it if it exited.
+ */
+void uthread_switch_finish(void);
+
+
+/**
+ * Private netpoll API
+ */
+
+/* Most threads netpoll_poll() makes ready at once */
+#define NETPOLL_BATCH 256
+
+/*
+ * netpoll_init - Create the epoll instance, and the eventfd that interrupts a
+ * blocked netpoll_poll(), if they do not exist yet
+ *
+ * Return: 0 in case of success, or -1 in case of failure
+ */
+int netpoll_init(void);
+
+/*
+ * netpoll_pending - Check whether threads wait for file descriptors
+ *
+ * Threads block in the functions of netpoll.h until the scheduler finds their
+ * file descriptor ready, their request to the ring or their offloaded call
+ * done, with netpoll_poll(). A run is not over as long as some thread waits.
+ */
+bool netpoll_pending(void);
+
+/*
+ * netpoll_poll - Collect the threads whose file descriptor became ready
+ * @timeout: Most time to wait for a file descriptor (in ns), 0 not to wait,
+ *	or -1 to wait until one is ready or netpoll_break() is called
+ * @threads: Set to the threads to make ready, NETPOLL_BATCH at most
+ *
+ * Several kernel threads can poll at once. Preemption must be disabled.
+ *
+ * Return: Number of threads set in @threads
+ */
+size_t netpoll_poll(int64_t timeout, struct uthread_tcb **threads);
+
+/*
+ * netpoll_break - Interrupt a blocked netpoll_poll()
+ *
+ * Makes the netpoll_poll() blocked at the time, or else the next one to be
+ * called, return right away.
+ */
+void netpoll_break(void);
+
+
+/**
+ * Private io_uring API
+ */
+
+/*
+ * struct uring_req - Read or write submitted to the ring by a thread
+ * @thread: Thread to make ready once the request completes
+ * @res: Set to the result of the request, like that of the system call, or
+ *	the negated error number
+ */
+struct uring_req {
+	struct uthread_tcb *thread;
+	int res;
+};
+
+/*
+ * uring_setup - Set up the ring, the first time
+ *
+ * Return: File descriptor of the ring, readable while completions are waiting,
+ * or -1 if io_uring is unavailable
+ */
+int uring_setup(void);
+
+/*
+ * uring_queue - Queue a read or a write at the current file position
+ * @req: Request, its thread set by the caller
+ * @write: Whether to write, or read
+ * @fd: File descriptor to read from or write to
+ * @buf: Buffer to read into or write from
+ * @count: Number of bytes to read or write
+ *
+ * The request is only submitted to the kernel by the next uring_submit(), so
+ * that the requests of many threads are submitted at once. Preemption must be
+ * disabled.
+ *
+ * Return: 0 in case of success, or -1 if the ring is full or unavailable
+ */
+int uring_queue(struct uring_req *req, bool write, int fd, const void *buf,
+		size_t count);
+
+/*
+ * uring_submit - Submit the queued requests with a single io_uring_enter()
+ *
+ * Preemption must be disabled.
+ *
+ * Return: true if every queued request was submitted, false if the kernel left
+ * some for the next call
+ */
+bool uring_submit(void);
+
+/*
+ * uring_submit_due - Check whether enough requests wait to be submitted
+ *
+ * Threads queue requests one at a time, submitting them on every scheduling
+ * pass would make a system call for each. Requests are worth submitting once
+ * a batch of them is queued, or once the oldest one has waited a short while.
+ */
+bool uring_submit_due(void);
+
+/*
+ * uring_pending - Check whether requests are not completed yet
+ */
+bool uring_pending(void);
+
+/*
+ * uring_completed - Check whether completions are waiting to be reaped,
+ * without a system call
+ */
+bool uring_completed(void);
+
+/*
+ * uring_reap - Collect the threads whose request completed
+ * @threads: Set to the threads to make ready
+ * @max: Most threads to collect
+ *
+ * Preemption must be disabled.
+ *
+ * Return: Number of threads set in @threads
+ */
+size_t uring_reap(struct uthread_tcb **threads, size_t max);
+
+
+/**
+ * Private inbox API
+ */
+
+enum {
+	INBOX_UNBLOCK,
+	INBOX_SEM_UP,
+	INBOX_CREATE,
+};
+
+/*
+ * struct inbox_msg - Message to the scheduler from another kernel thread
+ * @next: Next message in the inbox
+ * @type: What to do, INBOX_UNBLOCK, INBOX_SEM_UP or INBOX_CREATE
+ * @allocated: Whether the scheduler frees the message once done with it
+ * @thread: Thread to unblock
+ * @sem: Semaphore to release
+ * @func: Function of the thread to create
+ * @arg: Argument of @func
+ */
+struct inbox_msg {
+	struct inbox_msg *next;
+	int type;
+	bool allocated;
+	union {
+		struct uthread_tcb *thread;
+		struct semaphore *sem;
+		struct {
+			void (*func)(void *arg);
+			void *arg;
+		};
+	};
+};
+
+/*
+ * inbox_post - Post a message to the scheduler
+ * @msg: Message, which must stay valid until the scheduler is done with it
+ *
+ * Can be called from any kernel thread. The message is carried out by the next
+ * worker to poll, which is woken up if blocked in the poller.
+ */
+void inbox_post(struct inbox_msg *msg);
+
+/*
+ * inbox_ready - Check whether messages wait to be drained
+ */
+bool inbox_ready(void);
+
+/*
+ * inbox_pending - Check whether messages wait to be drained, or may still be
+ * posted while references are held with uthread_external_hold()
+ */
+bool inbox_pending(void);
+
+/*
+ * inbox_drain - Carry out the messages waiting in the inbox
+ * @threads: Set to the threads to make ready
+ * @max: Most threads to make ready
+ *
+ * Threads to unblock and threads created are collected, for the caller to make
+ * ready; semaphores are released right away. A single worker drains at a time,
+ * others calling it meanwhile get no thread. Preemption must be disabled.
+ *
+ * Return: Number of threads set in @threads
+ */
+size_t inbox_drain(struct uthread_tcb **threads, size_t max);
+
+/*
+ * uthread_unblock_external - Unblock a thread from another kernel thread
+ * @uthread: TCB of the thread to unblock
+ *
+ * Same as uthread_unblock(), but for kernel threads outside of the scheduler:
+ * the thread is unblocked by the next worker to drain the inbox.
+ *
+ * Return: 0 in case of success, or -1 in case of failure
+ */
+int uthread_unblock_external(struct uthread_tcb *uthread);
+
+/*
+ * uthread_create_detached - Create a detached thread, not ready yet
+ * @func: Function of the thread
+ * @arg: Argument of @func
+ *
+ * For the scheduler to make ready itself. The thread gets the default
+ * attributes. Preemption must be disabled.
+ *
+ * Return: TCB of the new thread, or NULL in case of failure
+ */
+struct uthread_tcb *uthread_create_detached(void (*func)(void *arg), void *arg);
+
+/*
+ * sem_release - Release a resource to a semaphore, without waking up anybody
+ * @sem: Semaphore to release
+ *
+ * Preemption must be disabled.
+ *
+ * Return: Thread the resource was handed to, for the caller to make ready, or
+ * NULL if none was waiting
+ */
+struct uthread_tcb *sem_release(struct semaphore *sem);
+
 #endif /* _UTHREAD_PRIVATE_H */
@@ -16,6 +16,7 @@ struct queue
 {
 	struct node *head;
 	struct node *tail;
+	int length;
 };
 
 
@@ -34,17 +35,8 @@ int queue_length(queue_t queue)
 		return -1;
 	}
 
-	/* Iterate from head of queue */
-	int length = 0;
-	struct node *curNode = queue->head;
-
-	while(curNode != NULL)
-	{
-		length++;
-		curNode = curNode->next;
-	}
-
-	return length;
+	/* Length is kept up to date by every operation, no need to walk */
+	return queue->length;
 }
 
 /**
@@ -65,6 +57,7 @@ queue_t queue_create(void)
 
 	q->head = NULL;
 	q->tail = NULL;
+	q->length = 0;
 	return q;
 }
 
@@ -78,7 +71,7 @@ queue_t queue_create(void)
 int queue_destroy(queue_t queue)
 {
 	/* If queue is NULL or not empty */
-	if(queue == NULL || queue_length(queue) != 0)
+	if(queue == NULL || queue->length != 0)
 	{
 		return -1;
 	}
@@ -105,10 +98,14 @@ int queue_enqueue(queue_t queue, void *data)
 
 	/* Create new node to enqueue */
 	struct node *newNode = malloc(sizeof(struct node));
+	if(newNode == NULL)
+	{
+		return -1;
+	}
 	newNode->data = data;
 	newNode->next = NULL;
 
-	if(queue_length(queue) == 0) /* If queue is empty */
+	if(queue->length == 0) /* If queue is empty */
 	{
 		queue->tail = newNode;
 		queue->head = newNode;
@@ -119,6 +116,7 @@ int queue_enqueue(queue_t queue, void *data)
 		queue->tail = newNode;
 	}
 
+	queue->length++;
 	return 0;
 }
 
@@ -134,7 +132,7 @@ int queue_enqueue(queue_t queue, void *data)
 int queue_dequeue(queue_t queue, void **data)
 {
 	/* fail case */
-	if((queue == NULL) || !queue_length(queue) || data == NULL)
+	if((queue == NULL) || !queue->length || data == NULL)
 	{
 		return -1;
 	}
@@ -143,7 +141,7 @@ int queue_dequeue(queue_t queue, void **data)
 	struct node *front = queue->head;
 
 	/* if queue has one item, empty queue */
-	if(queue_length(queue) == 1)
+	if(queue->length == 1)
 	{
 		queue->head = NULL;
 		queue->tail = NULL;
@@ -155,6 +153,7 @@ int queue_dequeue(queue_t queue, void **data)
 		queue->head = queue->head->next;
 	}
 
+	queue->length--;
 	*data = front->data;
 	free(front);
 	return 0;
@@ -186,7 +185,7 @@ int queue_delete(queue_t queue, void *data)
 		if(*(int *)curr->data == *(int *)data)
 		{
 
-			if(queue_length(queue) == 1)
+			if(queue->length == 1)
 			{
 				queue->head = NULL;
 				queue->tail = NULL;
@@ -207,6 +206,9 @@ int queue_delete(queue_t queue, void *data)
 			{
 				currPrev->next = curr->next;
 			}
+
+			queue->length--;
+			free(curr);
 			return 0;
 		}
 
@@ -238,8 +240,11 @@ int queue_iterate(queue_t queue, queue_func_t func)
 
 	while(curNode != NULL)
 	{
+		/* Save next node first, @func may delete the current one */
+		struct node *nextNode = curNode->next;
+
 		func(queue, curNode->data);
-		curNode = curNode->next;
+		curNode = nextNode;
 	}
 
 	return 0;
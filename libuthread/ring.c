@@ -0,0 +1,262 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "ring.h"
+
+/* Capacity of a new ring buffer queue, must be a power of two */
+#define RING_INITIAL_CAPACITY 16
+
+/*
+ * Items live in slots[head & mask] to slots[(tail - 1) & mask]. head and tail
+ * only ever increase, and wrap around freely since the capacity is a power of
+ * two.
+ */
+struct ring
+{
+	void **slots;
+	unsigned int mask;
+	unsigned int head;
+	unsigned int tail;
+};
+
+/**
+ * @brief Creates an empty ring buffer queue
+ *
+ * @param none
+ * @return Returns a struct ring address, NULL in case of failure
+ */
+ring_t ring_create(void)
+{
+	ring_t ring = malloc(sizeof(struct ring));
+
+	if(ring == NULL)
+	{
+		return NULL;
+	}
+
+	ring->slots = malloc(RING_INITIAL_CAPACITY * sizeof(void *));
+	if(ring->slots == NULL)
+	{
+		free(ring);
+		return NULL;
+	}
+
+	ring->mask = RING_INITIAL_CAPACITY - 1;
+	ring->head = 0;
+	ring->tail = 0;
+	return ring;
+}
+
+/**
+ * @brief Destroys an empty @ring
+ *
+ * @param ring The ring buffer queue to destroy
+ * @return Returns 0 if @ring was freed successfully,
+ * returns -1 if @ring is NULL or not empty
+ */
+int ring_destroy(ring_t ring)
+{
+	if(ring == NULL || ring->tail != ring->head)
+	{
+		return -1;
+	}
+
+	free(ring->slots);
+	free(ring);
+	return 0;
+}
+
+/**
+ * @brief Gets the length of @ring
+ *
+ * @param ring The ring buffer queue for which to find the length
+ * @return Returns integer length of @ring, -1 if @ring is NULL
+ */
+int ring_length(ring_t ring)
+{
+	if(ring == NULL)
+	{
+		return -1;
+	}
+
+	return ring->tail - ring->head;
+}
+
+/**
+ * @brief Copies items between the slots of @ring and a flat array, handling
+ * the wrap around the end of the slots
+ *
+ * @param ring The ring buffer queue
+ * @param pos Position of the first slot (before masking)
+ * @param items Flat array of items
+ * @param count Number of items to copy
+ * @param toSlots Copy from @items into the slots if true, the other way
+ * around otherwise
+ * @return none
+ */
+static void ring_copy(ring_t ring, unsigned int pos, void **items,
+		      unsigned int count, int toSlots)
+{
+	unsigned int first = pos & ring->mask;
+	unsigned int before = ring->mask + 1 - first;
+
+	if(before > count)
+	{
+		before = count;
+	}
+
+	if(toSlots)
+	{
+		memcpy(&ring->slots[first], items, before * sizeof(void *));
+		memcpy(ring->slots, items + before, (count - before) * sizeof(void *));
+	}
+	else
+	{
+		memcpy(items, &ring->slots[first], before * sizeof(void *));
+		memcpy(items + before, ring->slots, (count - before) * sizeof(void *));
+	}
+}
+
+/**
+ * @brief Makes room for @count more items in @ring, growing it to the next
+ * large enough power of two if needed
+ *
+ * @param ring The ring buffer queue to grow
+ * @param count Number of items about to be enqueued
+ * @return Returns 0 if @ring has room for @count more items, -1 in case of
+ * memory allocation error
+ */
+static int ring_reserve(ring_t ring, unsigned int count)
+{
+	unsigned int length = ring->tail - ring->head;
+	unsigned int capacity = ring->mask + 1;
+
+	if(capacity - length >= count)
+	{
+		return 0;
+	}
+
+	while(capacity - length < count)
+	{
+		capacity *= 2;
+		if(capacity == 0)
+		{
+			return -1;
+		}
+	}
+
+	/* Unwrap the items at the start of the new slots */
+	void **slots = malloc(capacity * sizeof(void *));
+	if(slots == NULL)
+	{
+		return -1;
+	}
+
+	ring_copy(ring, ring->head, slots, length, 0);
+	free(ring->slots);
+
+	ring->slots = slots;
+	ring->mask = capacity - 1;
+	ring->head = 0;
+	ring->tail = length;
+	return 0;
+}
+
+/**
+ * @brief Enqueues the address of @data into @ring
+ *
+ * @param ring The ring buffer queue for which to enqueue data
+ * @param data Address of data to enqueue
+ * @return Returns -1 if @ring or @data is NULL or in case of memory
+ * allocation error, returns 0 if enqueue was successful
+ */
+int ring_enqueue(ring_t ring, void *data)
+{
+	if(ring == NULL || data == NULL || ring_reserve(ring, 1))
+	{
+		return -1;
+	}
+
+	ring->slots[ring->tail++ & ring->mask] = data;
+	return 0;
+}
+
+/**
+ * @brief Dequeues the oldest item of @ring and assigns it to @data
+ *
+ * @param ring The ring buffer queue to be popped
+ * @param data Address of data pointer to be assigned
+ * @return Returns -1 if @ring, @data is NULL, or @ring is empty,
+ * returns 0 if dequeue was successful
+ */
+int ring_dequeue(ring_t ring, void **data)
+{
+	if(ring == NULL || data == NULL || ring->tail == ring->head)
+	{
+		return -1;
+	}
+
+	*data = ring->slots[ring->head++ & ring->mask];
+	return 0;
+}
+
+/**
+ * @brief Enqueues @count items from @data into @ring, all or none of them
+ *
+ * @param ring The ring buffer queue for which to enqueue data
+ * @param data Array of items to enqueue
+ * @param count Number of items to enqueue
+ * @return Returns -1 if @ring or @data or any item is NULL, if @count is
+ * negative or in case of memory allocation error, returns @count otherwise
+ */
+int ring_enqueue_n(ring_t ring, void **data, int count)
+{
+	if(ring == NULL || data == NULL || count < 0)
+	{
+		return -1;
+	}
+
+	for(int i = 0; i < count; i++)
+	{
+		if(data[i] == NULL)
+		{
+			return -1;
+		}
+	}
+
+	if(ring_reserve(ring, count))
+	{
+		return -1;
+	}
+
+	ring_copy(ring, ring->tail, data, count, 1);
+	ring->tail += count;
+	return count;
+}
+
+/**
+ * @brief Dequeues up to @count of the oldest items of @ring into @data
+ *
+ * @param ring The ring buffer queue to be popped
+ * @param data Array receiving the items
+ * @param count Maximum number of items to dequeue
+ * @return Returns -1 if @ring or @data is NULL or if @count is negative,
+ * returns the number of items dequeued otherwise
+ */
+int ring_dequeue_n(ring_t ring, void **data, int count)
+{
+	if(ring == NULL || data == NULL || count < 0)
+	{
+		return -1;
+	}
+
+	unsigned int length = ring->tail - ring->head;
+	if((unsigned int)count > length)
+	{
+		count = length;
+	}
+
+	ring_copy(ring, ring->head, data, count, 0);
+	ring->head += count;
+	return count;
+}
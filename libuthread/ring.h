@@ -0,0 +1,89 @@
+#ifndef _RING_H
+#define _RING_H
+
+/*
+ * ring_t - Ring buffer queue type
+ *
+ * A ring buffer queue is a FIFO data structure with the same semantics as a
+ * queue_t (see queue.h), but which stores the enqueued items contiguously in a
+ * circular array instead of a linked list. The array grows to the next power of
+ * two when full, and never shrinks.
+ *
+ * All operations are O(1), amortized for enqueueing. Items can also be moved in
+ * bulk, many items per call.
+ */
+typedef struct ring *ring_t;
+
+/*
+ * ring_create - Allocate an empty ring buffer queue
+ *
+ * Return: Pointer to new empty ring buffer queue. NULL in case of failure when
+ * allocating the new queue.
+ */
+ring_t ring_create(void);
+
+/*
+ * ring_destroy - Deallocate a ring buffer queue
+ * @ring: Ring buffer queue to deallocate
+ *
+ * Return: -1 if @ring is NULL or if @ring is not empty. 0 if @ring was
+ * successfully destroyed.
+ */
+int ring_destroy(ring_t ring);
+
+/*
+ * ring_enqueue - Enqueue data item
+ * @ring: Ring buffer queue in which to enqueue item
+ * @data: Address of data item to enqueue
+ *
+ * Return: -1 if @ring or @data are NULL, or in case of memory allocation error
+ * when growing the queue. 0 if @data was successfully enqueued in @ring.
+ */
+int ring_enqueue(ring_t ring, void *data);
+
+/*
+ * ring_dequeue - Dequeue data item
+ * @ring: Ring buffer queue in which to dequeue item
+ * @data: Address of data pointer where item is received
+ *
+ * Remove the oldest item of @ring and assign this item to @data.
+ *
+ * Return: -1 if @ring or @data are NULL, or if the queue is empty. 0 if @data
+ * was set with the oldest item available in @ring.
+ */
+int ring_dequeue(ring_t ring, void **data);
+
+/*
+ * ring_enqueue_n - Enqueue several data items
+ * @ring: Ring buffer queue in which to enqueue items
+ * @data: Array of the data items to enqueue, oldest first
+ * @count: Number of items in @data
+ *
+ * Either all the items are enqueued, or none of them is.
+ *
+ * Return: -1 if @ring or @data are NULL, if @count is negative, if any of the
+ * items is NULL, or in case of memory allocation error when growing the queue.
+ * @count if all the items were successfully enqueued in @ring.
+ */
+int ring_enqueue_n(ring_t ring, void **data, int count);
+
+/*
+ * ring_dequeue_n - Dequeue several data items
+ * @ring: Ring buffer queue in which to dequeue items
+ * @data: Array where the items are received, oldest first
+ * @count: Maximum number of items to dequeue
+ *
+ * Return: -1 if @ring or @data are NULL, or if @count is negative. Number of
+ * items dequeued into @data otherwise, which is 0 if @ring is empty.
+ */
+int ring_dequeue_n(ring_t ring, void **data, int count);
+
+/*
+ * ring_length - Ring buffer queue length
+ * @ring: Ring buffer queue to get the length of
+ *
+ * Return: -1 if @ring is NULL. Length of @ring otherwise.
+ */
+int ring_length(ring_t ring);
+
+#endif /* _RING_H */
@@ -1,16 +1,34 @@
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdlib.h>
 #include <stdio.h>
 
+#include "list.h"
 #include "private.h"
-#include "queue.h"
 #include "sem.h"
+#include "spinlock.h"
 #include "uthread.h"
 
 struct semaphore
 {
+	spinlock_t lock;
 	int count;
-	queue_t blockedQ;
+	struct list blockedQ;
+
+	/* Switch to the unblocked thread right away in sem_up() */
+	bool handoff;
+};
+
+/*
+ * A thread waiting on a semaphore, kept on the waiting thread's stack so that
+ * blocking never allocates memory. The resource is handed over by sem_up()
+ * when it dequeues the waiter, so that the woken thread does not touch the
+ * semaphore again, which may have been destroyed by then.
+ */
+struct sem_waiter
+{
+	struct list_node link;
+	struct uthread_tcb *thread;
 };
 
 /**
@@ -28,8 +46,10 @@ sem_t sem_create(size_t count)
 		return NULL;
 	}
 
+	sem->lock.locked = 0;
 	sem->count = count;
-	sem->blockedQ = queue_create();
+	list_init(&sem->blockedQ);
+	sem->handoff = false;
 
 	return sem;
 }
@@ -42,16 +62,33 @@ sem_t sem_create(size_t count)
  */
 int sem_destroy(sem_t sem)
 {
-	if(queue_length(sem->blockedQ) || sem == NULL)
+	if(sem == NULL || list_length(&sem->blockedQ))
 	{
 		return -1;
 	}
 
-	queue_destroy(sem->blockedQ);
 	free(sem);
 	return 0;
 }
 
+/**
+ * @brief Set whether releasing the semaphore switches to the thread it unblocks
+ *
+ * @param sem The semaphore to configure
+ * @param handoff True to switch to unblocked threads right away
+ * @return Returns 0 if configured successfully, -1 if sem is NULL
+ */
+int sem_set_handoff(sem_t sem, bool handoff)
+{
+	if(sem == NULL)
+	{
+		return -1;
+	}
+
+	sem->handoff = handoff;
+	return 0;
+}
+
 /**
  * @brief Take a resource from the semaphore, block current thread if resource is unavailable
  *
@@ -65,29 +102,56 @@ int sem_down(sem_t sem)
 		return -1;
 	}
 
-	int initFlag = 1;
-
-	while(sem->count == 0)
+	/* Take the resource right away if it is available */
+	preempt_disable();
+	spin_lock(&sem->lock);
+	if(sem->count > 0)
 	{
-		/* On first iteration */
-		if(initFlag)
-		{
-			initFlag = 0;
-
-			/* Add to blocked queue */
-			queue_enqueue(sem->blockedQ, uthread_current());
-		}
-
-		/* Block until semaphore becomes available */
-		uthread_block();
+		sem->count -= 1;
+		spin_unlock(&sem->lock);
+		preempt_enable();
+		return 0;
 	}
 
-	/* Once it becomes available take it i.e. decrement semaphore's count */
-	sem->count -= 1;
+	/* Otherwise wait in blocked queue until sem_up() hands it to us */
+	struct sem_waiter waiter = { .thread = uthread_current() };
+	list_push_back(&sem->blockedQ, &waiter.link);
+	spin_unlock(&sem->lock);
+
+	uthread_block();
 
 	return 0;
 }
 
+/**
+ * @brief Release a resource to the semaphore, or hand it to the first thread in
+ * the blocked queue, without waking it up, preemption must be disabled
+ *
+ * @param sem Semaphore to release
+ * @return struct uthread_tcb of the thread the resource was handed to, NULL
+ * if none was waiting
+ */
+struct uthread_tcb *sem_release(sem_t sem)
+{
+	struct uthread_tcb *thread = NULL;
+
+	spin_lock(&sem->lock);
+	struct list_node *popped = list_pop_front(&sem->blockedQ);
+
+	/* If no thread is waiting, release the resource */
+	if(popped == NULL)
+	{
+		sem->count += 1;
+	}
+	else
+	{
+		thread = list_entry(popped, struct sem_waiter, link)->thread;
+	}
+	spin_unlock(&sem->lock);
+
+	return thread;
+}
+
 /**
  * @brief Release a resource to the semaphore, unblock first in blocked queue if any
  *
@@ -101,18 +165,22 @@ int sem_up(sem_t sem)
 		return -1;
 	}
 
-	/* Release the lock */
-	sem->count += 1;
+	preempt_disable();
+	struct uthread_tcb *thread = sem_release(sem);
 
-	/* 'Wake up' first thread in blockedQ */
-	if(queue_length(sem->blockedQ))
+	/* 'wake up' the thread the resource was handed to */
+	if(thread)
 	{
-		void *popped;
-		queue_dequeue(sem->blockedQ, &popped);
-
-		struct uthread_tcb *wakingThread = popped;
-		uthread_unblock(wakingThread);
+		if(sem->handoff)
+		{
+			uthread_unblock_handoff(thread);
+		}
+		else
+		{
+			uthread_unblock(thread);
+		}
 	}
+	preempt_enable();
 
 	return 0;
 }
@@ -1,6 +1,7 @@
 #ifndef _SEMAPHORE_H
 #define _SEMAPHORE_H
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <sys/types.h>
 
@@ -37,6 +38,21 @@ sem_t sem_create(size_t count);
  */
 int sem_destroy(sem_t sem);
 
+/*
+ * sem_set_handoff - Configure how a semaphore wakes up threads
+ * @sem: Semaphore to configure
+ * @handoff: Whether to switch to unblocked threads right away
+ *
+ * By default, releasing @sem while threads are waiting on it hands the
+ * resource to the oldest one, which gets in line behind all the ready threads.
+ * In handoff mode, the releasing thread switches to it immediately instead,
+ * unless it has a lower priority: in a producer/consumer pipeline, a value
+ * goes to the next stage without waiting for every other ready thread to run.
+ *
+ * Return: -1 if @sem is NULL. 0 if @sem was successfully configured.
+ */
+int sem_set_handoff(sem_t sem, bool handoff);
+
 /*
  * sem_down - Take a semaphore
  * @sem: Semaphore to take
@@ -64,4 +80,18 @@ int sem_down(sem_t sem);
  */
 int sem_up(sem_t sem);
 
+/*
+ * sem_up_external - Release a semaphore from outside of the threads
+ * @sem: Semaphore to release
+ *
+ * Same as sem_up(), for kernel threads other than those running the threads,
+ * like the callbacks of a library: the semaphore is released by the scheduler
+ * soon after, while a run is going. See uthread_external_hold() to keep the
+ * run going until then.
+ *
+ * Return: -1 if @sem is NULL or in case of memory allocation error. 0 if the
+ * release was posted.
+ */
+int sem_up_external(sem_t sem);
+
 #endif /* _SEMAPHORE_H */
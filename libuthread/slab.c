@@ -0,0 +1,178 @@
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "private.h"
+
+/* Size of the memory chunks objects are carved from (in bytes) */
+#define SLAB_SIZE 65536
+
+/* Header at the start of every slab, chaining the slabs of a cache */
+struct slab
+{
+	struct slab *next;
+};
+
+/* Link stored in a free object, chaining the free objects of a cache */
+struct slab_object
+{
+	struct slab_object *next;
+};
+
+struct slab_cache
+{
+	size_t objSize;
+	size_t align;
+	struct slab *slabs;
+	struct slab_object *freeList;
+};
+
+/**
+ * @brief Create a cache of fixed-size objects
+ *
+ * @param size Size of the objects (in bytes)
+ * @param align Alignment of the objects, must be a power of two
+ * @return Returns the new cache, NULL in case of failure
+ */
+slab_t slab_create(size_t size, size_t align)
+{
+	if(size == 0 || (align & (align - 1)) != 0)
+	{
+		return NULL;
+	}
+
+	slab_t cache = malloc(sizeof(struct slab_cache));
+
+	if(cache == NULL)
+	{
+		return NULL;
+	}
+
+	if(align < sizeof(void *))
+	{
+		align = sizeof(void *);
+	}
+
+	/* Every object must be big enough to hold a free list link */
+	if(size < sizeof(struct slab_object))
+	{
+		size = sizeof(struct slab_object);
+	}
+
+	cache->objSize = (size + align - 1) & ~(align - 1);
+	cache->align = align;
+	cache->slabs = NULL;
+	cache->freeList = NULL;
+
+	return cache;
+}
+
+/**
+ * @brief Carve a new slab into free objects
+ *
+ * @param cache Cache to grow
+ * @return Returns 0 if the cache grew, -1 in case of memory allocation error
+ */
+static int slab_grow(slab_t cache)
+{
+	/* The slab header takes the first aligned object slot */
+	size_t headerSize = (sizeof(struct slab) + cache->align - 1) & ~(cache->align - 1);
+	size_t slabSize = SLAB_SIZE;
+
+	if(slabSize < headerSize + cache->objSize)
+	{
+		slabSize = headerSize + cache->objSize;
+	}
+
+	struct slab *slab = aligned_alloc(cache->align,
+					  (slabSize + cache->align - 1) & ~(cache->align - 1));
+
+	if(slab == NULL)
+	{
+		return -1;
+	}
+
+	slab->next = cache->slabs;
+	cache->slabs = slab;
+
+	/* Push objects in reverse so that they get handed out in address order */
+	size_t count = (slabSize - headerSize) / cache->objSize;
+	char *first = (char *)slab + headerSize;
+
+	for(size_t i = count; i > 0; i--)
+	{
+		struct slab_object *obj = (struct slab_object *)(first + (i - 1) * cache->objSize);
+
+		obj->next = cache->freeList;
+		cache->freeList = obj;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Allocate an object from a cache
+ *
+ * @param cache Cache to allocate from
+ * @return Returns the address of an uninitialized object, NULL in case of
+ * failure
+ */
+void *slab_alloc(slab_t cache)
+{
+	if(cache == NULL)
+	{
+		return NULL;
+	}
+
+	if(cache->freeList == NULL && slab_grow(cache))
+	{
+		return NULL;
+	}
+
+	struct slab_object *obj = cache->freeList;
+	cache->freeList = obj->next;
+
+	return obj;
+}
+
+/**
+ * @brief Give an object back to its cache
+ *
+ * @param cache Cache the object was allocated from
+ * @param obj Object to free
+ * @return none
+ */
+void slab_free(slab_t cache, void *obj)
+{
+	if(cache == NULL || obj == NULL)
+	{
+		return;
+	}
+
+	struct slab_object *freed = obj;
+	freed->next = cache->freeList;
+	cache->freeList = freed;
+}
+
+/**
+ * @brief Destroy a cache and every object allocated from it
+ *
+ * @param cache Cache to destroy
+ * @return none
+ */
+void slab_destroy(slab_t cache)
+{
+	if(cache == NULL)
+	{
+		return;
+	}
+
+	while(cache->slabs)
+	{
+		struct slab *next = cache->slabs->next;
+
+		free(cache->slabs);
+		cache->slabs = next;
+	}
+
+	free(cache);
+}
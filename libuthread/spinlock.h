@@ -0,0 +1,53 @@
+#ifndef _SPINLOCK_H
+#define _SPINLOCK_H
+
+/*
+ * This header is only meant to be included by files from the libuthread. It
+ * defines the spinlocks protecting the short critical sections shared between
+ * the kernel threads running the scheduler.
+ *
+ * A spinlock must only be taken with preemption disabled: a thread preempted
+ * while holding one could otherwise be resumed on another kernel thread, or
+ * never be resumed at all by the kernel thread that is now spinning on it.
+ */
+
+/*
+ * cpu_relax - Tell the CPU that we are busy-waiting
+ */
+static inline void cpu_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	__asm__ __volatile__("pause");
+#elif defined(__aarch64__)
+	__asm__ __volatile__("yield");
+#endif
+}
+
+/*
+ * spinlock_t - Test-and-test-and-set spinlock, initialized to zero (unlocked)
+ */
+typedef struct spinlock {
+	int locked;
+} spinlock_t;
+
+/*
+ * spin_lock - Acquire a spinlock
+ * @lock: Spinlock to acquire
+ */
+static inline void spin_lock(spinlock_t *lock)
+{
+	while (__atomic_exchange_n(&lock->locked, 1, __ATOMIC_ACQUIRE))
+		while (__atomic_load_n(&lock->locked, __ATOMIC_RELAXED))
+			cpu_relax();
+}
+
+/*
+ * spin_unlock - Release a spinlock
+ * @lock: Spinlock to release
+ */
+static inline void spin_unlock(spinlock_t *lock)
+{
+	__atomic_store_n(&lock->locked, 0, __ATOMIC_RELEASE);
+}
+
+#endif /* _SPINLOCK_H */
@@ -0,0 +1,384 @@
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "private.h"
+#include "spinlock.h"
+
+/* Number of requests that can be queued between two submissions */
+#define URING_SQ_ENTRIES 256
+
+/* Number of requests that can be in flight at once */
+#define URING_CQ_ENTRIES 16384
+
+/*
+ * A scheduling pass submits the queued requests once there are this many, or
+ * once the oldest one has waited this long (in ns)
+ */
+#define URING_SUBMIT_BATCH 32
+#define URING_SUBMIT_DELAY 50000
+
+/*
+ * The ring, set up once by uring_setup() (under the caller's lock) and used
+ * through raw system calls.
+ * Threads queue requests in the submission queue under sqLock, and only
+ * publish them: a worker submits all of them with a single io_uring_enter()
+ * when it polls, or on a scheduling pass once enough of them wait.
+ * Completions are read from the completion queue, shared with the kernel,
+ * under cqLock.
+ */
+static int ringFd = -1;
+static spinlock_t sqLock, cqLock;
+
+static unsigned int *sqHead, *sqTail, *sqArray;
+static unsigned int sqMask, sqEntries;
+static struct io_uring_sqe *sqes;
+
+static unsigned int *cqHead, *cqTail;
+static unsigned int cqMask, cqEntries;
+static struct io_uring_cqe *cqes;
+
+/*
+ * Requests queued but not submitted yet, time the oldest of them was queued
+ * at, and requests not completed yet
+ */
+static unsigned int unsubmitted;
+static uint64_t unsubmittedSince;
+static unsigned int inflight;
+
+/**
+ * @brief Get the current time
+ *
+ * @param none
+ * @return uint64_t - CLOCK_MONOTONIC time, in ns
+ */
+static uint64_t uring_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * @brief Call io_uring_setup(), if the system call is known
+ *
+ * @param entries Size of the submission queue
+ * @param params Parameters of the ring
+ * @return int - File descriptor of the ring, -1 in case of failure
+ */
+static int sys_uring_setup(unsigned int entries, struct io_uring_params *params)
+{
+#ifdef __NR_io_uring_setup
+	return syscall(__NR_io_uring_setup, entries, params);
+#else
+	(void)entries;
+	(void)params;
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+/**
+ * @brief Call io_uring_enter() to submit requests
+ *
+ * @param count Number of requests to submit
+ * @return int - Number of requests submitted, -1 in case of failure
+ */
+static int sys_uring_enter(unsigned int count)
+{
+#ifdef __NR_io_uring_enter
+	return syscall(__NR_io_uring_enter, ringFd, count, 0, 0, NULL, 0);
+#else
+	(void)count;
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+/**
+ * @brief Set up the ring
+ *
+ * Needs a kernel that reads and writes at the current file position (5.6), as
+ * files are read and written like read() and write() do.
+ *
+ * @param none
+ * @return int - File descriptor of the ring, -1 if io_uring is unavailable
+ */
+int uring_setup(void)
+{
+	struct io_uring_params params;
+	void *sq, *cq;
+
+	if(ringFd >= 0)
+	{
+		return ringFd;
+	}
+
+	memset(&params, 0, sizeof(params));
+	params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_CLAMP;
+	params.cq_entries = URING_CQ_ENTRIES;
+
+	int fd = sys_uring_setup(URING_SQ_ENTRIES, &params);
+	if(fd < 0)
+	{
+		return -1;
+	}
+	if(!(params.features & IORING_FEAT_RW_CUR_POS))
+	{
+		close(fd);
+		return -1;
+	}
+
+	size_t sqSize = params.sq_off.array +
+		params.sq_entries * sizeof(unsigned int);
+	size_t cqSize = params.cq_off.cqes +
+		params.cq_entries * sizeof(struct io_uring_cqe);
+	size_t sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+
+	sq = mmap(NULL, sqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+		  fd, IORING_OFF_SQ_RING);
+	cq = mmap(NULL, cqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+		  fd, IORING_OFF_CQ_RING);
+	sqes = mmap(NULL, sqesSize, PROT_READ | PROT_WRITE,
+		    MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+	if(sq == MAP_FAILED || cq == MAP_FAILED || sqes == MAP_FAILED)
+	{
+		if(sq != MAP_FAILED)
+		{
+			munmap(sq, sqSize);
+		}
+		if(cq != MAP_FAILED)
+		{
+			munmap(cq, cqSize);
+		}
+		if(sqes != MAP_FAILED)
+		{
+			munmap(sqes, sqesSize);
+		}
+		close(fd);
+		return -1;
+	}
+
+	sqHead = (unsigned int *)((char *)sq + params.sq_off.head);
+	sqTail = (unsigned int *)((char *)sq + params.sq_off.tail);
+	sqArray = (unsigned int *)((char *)sq + params.sq_off.array);
+	sqMask = *(unsigned int *)((char *)sq + params.sq_off.ring_mask);
+	sqEntries = params.sq_entries;
+
+	cqHead = (unsigned int *)((char *)cq + params.cq_off.head);
+	cqTail = (unsigned int *)((char *)cq + params.cq_off.tail);
+	cqes = (struct io_uring_cqe *)((char *)cq + params.cq_off.cqes);
+	cqMask = *(unsigned int *)((char *)cq + params.cq_off.ring_mask);
+	cqEntries = params.cq_entries;
+
+	__atomic_store_n(&ringFd, fd, __ATOMIC_RELEASE);
+	return fd;
+}
+
+/**
+ * @brief Queue a read or a write, to be submitted by the next uring_submit()
+ *
+ * The submission queue is submitted right away if it is full.
+ *
+ * @param req Request, set to the thread to wake up once it completes
+ * @param write Whether to write, or read
+ * @param fd File descriptor to read from or write to, at its current position
+ * @param buf Buffer to read into or write from
+ * @param count Number of bytes to read or write
+ * @return int - 0 in case of success, -1 if the ring is full or unavailable
+ */
+int uring_queue(struct uring_req *req, bool write, int fd, const void *buf,
+		size_t count)
+{
+	if(__atomic_load_n(&ringFd, __ATOMIC_ACQUIRE) < 0)
+	{
+		return -1;
+	}
+
+	spin_lock(&sqLock);
+
+	/* Leave room in the completion queue for every request in flight */
+	if(inflight >= cqEntries)
+	{
+		spin_unlock(&sqLock);
+		return -1;
+	}
+
+	unsigned int tail = *sqTail;
+	if(tail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) >= sqEntries)
+	{
+		spin_unlock(&sqLock);
+		uring_submit();
+		spin_lock(&sqLock);
+
+		tail = *sqTail;
+		if(tail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) >= sqEntries)
+		{
+			spin_unlock(&sqLock);
+			return -1;
+		}
+	}
+
+	unsigned int index = tail & sqMask;
+	struct io_uring_sqe *sqe = &sqes[index];
+
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = write ? IORING_OP_WRITE : IORING_OP_READ;
+	sqe->fd = fd;
+	sqe->addr = (uintptr_t)buf;
+	sqe->len = count > UINT32_MAX ? UINT32_MAX : count;
+	sqe->off = (uint64_t)-1;
+	sqe->user_data = (uintptr_t)req;
+	sqArray[index] = index;
+
+	__atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+	if(unsubmitted == 0)
+	{
+		__atomic_store_n(&unsubmittedSince, uring_now(), __ATOMIC_RELAXED);
+	}
+	__atomic_store_n(&unsubmitted, unsubmitted + 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&inflight, 1, __ATOMIC_SEQ_CST);
+	spin_unlock(&sqLock);
+
+	return 0;
+}
+
+/**
+ * @brief Check whether a scheduling pass should submit the queued requests,
+ * without taking sqLock
+ *
+ * @param none
+ * @return Returns true if URING_SUBMIT_BATCH requests wait to be submitted,
+ * or if the oldest of them waited URING_SUBMIT_DELAY
+ */
+bool uring_submit_due(void)
+{
+	unsigned int count = __atomic_load_n(&unsubmitted, __ATOMIC_RELAXED);
+
+	if(count == 0)
+	{
+		return false;
+	}
+
+	return count >= URING_SUBMIT_BATCH ||
+		uring_now() - __atomic_load_n(&unsubmittedSince, __ATOMIC_RELAXED) >=
+		URING_SUBMIT_DELAY;
+}
+
+/**
+ * @brief Submit all the queued requests with a single system call
+ *
+ * @param none
+ * @return Returns true if every request was submitted, false if some are left
+ * for the next submission (the kernel ran short of resources)
+ */
+bool uring_submit(void)
+{
+	unsigned int count;
+
+	spin_lock(&sqLock);
+	count = unsubmitted;
+	__atomic_store_n(&unsubmitted, 0, __ATOMIC_RELAXED);
+	spin_unlock(&sqLock);
+
+	if(count == 0)
+	{
+		return true;
+	}
+
+	/* The system call is made without holding sqLock, for others to queue */
+	int submitted;
+	while((submitted = sys_uring_enter(count)) < 0 && errno == EINTR);
+
+	if(submitted < (int)count)
+	{
+		/* Leave the rest to the next submission */
+		spin_lock(&sqLock);
+		if(unsubmitted == 0)
+		{
+			__atomic_store_n(&unsubmittedSince, uring_now(),
+					 __ATOMIC_RELAXED);
+		}
+		__atomic_store_n(&unsubmitted,
+				 unsubmitted + count - (submitted > 0 ? submitted : 0),
+				 __ATOMIC_RELAXED);
+		spin_unlock(&sqLock);
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * @brief Check whether requests are queued or in flight
+ *
+ * @param none
+ * @return Returns true if some request is not completed yet
+ */
+bool uring_pending(void)
+{
+	return __atomic_load_n(&inflight, __ATOMIC_SEQ_CST) != 0;
+}
+
+/**
+ * @brief Check whether requests completed, without a system call
+ *
+ * @param none
+ * @return Returns true if the completion queue is not empty
+ */
+bool uring_completed(void)
+{
+	return __atomic_load_n(&ringFd, __ATOMIC_ACQUIRE) >= 0 &&
+		__atomic_load_n(cqTail, __ATOMIC_ACQUIRE) !=
+		__atomic_load_n(cqHead, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Collect the threads whose request completed
+ *
+ * @param threads Set to the threads to make ready
+ * @param max Most threads to collect
+ * @return size_t - Number of threads in @threads
+ */
+size_t uring_reap(struct uthread_tcb **threads, size_t max)
+{
+	size_t count = 0;
+
+	if(__atomic_load_n(&ringFd, __ATOMIC_ACQUIRE) < 0 || max == 0)
+	{
+		return 0;
+	}
+
+	spin_lock(&cqLock);
+
+	unsigned int head = *cqHead;
+	unsigned int tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+
+	while(head != tail && count < max)
+	{
+		struct io_uring_cqe *cqe = &cqes[head & cqMask];
+		struct uring_req *req = (struct uring_req *)(uintptr_t)cqe->user_data;
+
+		/*
+		 * The request lives on the stack of its thread, which only runs again
+		 * once made ready by the caller
+		 */
+		threads[count++] = req->thread;
+		req->res = cqe->res;
+		head++;
+	}
+
+	__atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+	spin_unlock(&cqLock);
+
+	__atomic_sub_fetch(&inflight, count, __ATOMIC_SEQ_CST);
+	return count;
+}
@@ -1,255 +1,2519 @@
 #include <assert.h>
+#include <pthread.h>
+#include <sched.h>
 #include <signal.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
 
+#include "list.h"
 #include "private.h"
+#include "spinlock.h"
 #include "uthread.h"
-#include "queue.h"
 
 #define RUNNING 0
 #define READY 1
 #define EXITED 2
 #define BLOCKED 3
 
-struct node
+/* Size of a cache line (in bytes) */
+#define CACHE_LINE_SIZE 64
+
+/* How many times a worker polls a busy thread before giving up its CPU */
+#define CLAIM_SPINS 64
+
+/* How often (in picks) a worker looks at runQ before its own deque */
+#define RUNQ_CHECK_INTERVAL 61
+
+/* Number of priority levels */
+#define PRIO_LEVELS (UTHREAD_PRIO_MAX + 1)
+
+/* Level of the deadline class, above all the priorities */
+#define EDF_LEVEL PRIO_LEVELS
+
+/* How often (in milliseconds) MLFQ gives demoted threads their priority back */
+#define MLFQ_BOOST_INTERVAL 100
+
+/* How often (in ns) busy workers poll the file descriptors threads wait for */
+#define NETPOLL_INTERVAL 1000000
+
+/* Number of threads the scheduler's heaps can hold at first */
+#define HEAP_INITIAL_SIZE 64
+
+/* Number of thread-local keys stored inline in the TCB */
+#define SPECIFIC_INLINE 8
+
+/* Most rounds of destructors a thread runs when it exits */
+#define SPECIFIC_DESTRUCTOR_ROUNDS 4
+
+/*
+ * TCBs are cache line aligned and come from a slab cache. The fields used on
+ * every context switch come first so that they share the first cache line; the
+ * execution context is embedded in the TCB, right there with the assembly
+ * backend where it is only a saved stack pointer, or at the end with the much
+ * larger ucontext one.
+ */
+struct uthread_tcb
+{
+#ifdef UTHREAD_CTX_ASM
+	uthread_ctx_t ctx;
+#endif
+	int state;
+
+	/* Set while a worker runs the thread, until its context is saved */
+	int onCpu;
+
+	/* Priority given to the thread, and the one it currently runs at */
+	int priority;
+	int level;
+
+	/* Link in runQ, unused while in a worker's deque, NULL outside of runQ */
+	struct list_node link;
+
+	/*
+	 * Fair policy: CPU time used (in ns) scaled by the thread's weight, and
+	 * time at which the thread last started running
+	 */
+	uint64_t vruntime;
+	uint64_t runStart;
+	unsigned int weight;
+
+	/* Virtual runtime the thread was last queued with */
+	uint64_t fairKey;
+
+	/* Identifier of the thread */
+	uthread_tid_t tid;
+
+	/*
+	 * Return value, thread waiting to join the thread, whether the thread is
+	 * detached, and whether it exited and waits to be joined (all protected by
+	 * tcbLock)
+	 */
+	void *retval;
+	struct uthread_join *joiner;
+	bool detached;
+	bool zombie;
+
+	/*
+	 * Deadline class: period and relative deadline (in ns, 0 for threads of
+	 * other classes), release time and absolute deadline of the current job
+	 */
+	uint64_t period;
+	uint64_t relDeadline;
+	uint64_t release;
+	uint64_t deadline;
+
+	/* Timer of the thread while it sleeps, in sleepWheel */
+	struct wheel_timer sleepTimer;
+
+	/*
+	 * Values of the thread-local keys: the first ones inline, the others in a
+	 * table allocated the first time one of them is set
+	 */
+	void *specific[SPECIFIC_INLINE];
+	void **specificOverflow;
+
+	/* Stack segment, only needed when creating and destroying the thread */
+	char *stackPointer;
+	size_t stackSize;
+	size_t guardSize;
+
+#ifndef UTHREAD_CTX_ASM
+	uthread_ctx_t ctx;
+#endif
+} __attribute__((aligned(CACHE_LINE_SIZE)));
+
+/*
+ * A thread waiting in uthread_join(), kept on its stack, which gets the return
+ * value of the thread it joins
+ */
+struct uthread_join
 {
-	void *next;
-	void *data;
+	struct uthread_tcb *thread;
+	void *retval;
 };
 
-struct queue
+/*
+ * A worker is a kernel thread running the scheduler: it runs ready threads one
+ * at a time, switching straight from one to the next when they yield, block or
+ * exit, and goes back to its idle context when none is ready.
+ *
+ * With several workers, the threads created or unblocked by a thread are
+ * pushed on the deque of the worker running it, and that worker takes them back
+ * first, in LIFO order, while their data is still in its caches. Yielding
+ * threads go to the global runQ instead, so that they let the others run. A
+ * worker with nothing left to run steals from the other workers' deques. A
+ * single worker only uses runQ, in FIFO order.
+ *
+ * Only threads of the default priority go to deques, all the others wait in
+ * runQ, where each priority has its own list. A bitmap of the non-empty lists
+ * makes finding the highest priority thread O(1).
+ *
+ * The fair policy replaces all of that with a single min-heap of ready threads,
+ * ordered by virtual runtime, that all the workers share.
+ *
+ * Threads of the deadline class come before all the others, earliest deadline
+ * first, from another heap. Their level is EDF_LEVEL, which has its own bit in
+ * runBitmap.
+ *
+ * The thread a worker switches away from is only released by whoever runs on
+ * the worker next, in uthread_switch_finish(), once its context has been saved.
+ * Until then the thread's onCpu flag stays set, and a worker picking it (it may
+ * have been queued as soon as it was about to switch out) waits for the flag to
+ * clear before switching to it. An exited thread is freed there as well, so
+ * exiting takes a single context switch.
+ */
+struct worker
+{
+	/* Thread running on the worker, NULL in the idle context */
+	struct uthread_tcb *current;
+
+	/* Thread the worker just switched away from */
+	struct uthread_tcb *prev;
+
+	/* Make prev ready once switched away from, for handoffs */
+	bool readyPrev;
+
+	/* Ready threads, pushed by the threads running on this worker */
+	struct deque deque;
+
+	/* Pick counter, and state of the random choice of steal victims */
+	unsigned int schedTick;
+	unsigned int stealSeed;
+
+	/* Context of the worker's idle loop */
+	uthread_ctx_t idleCtx;
+
+	/* Threads made ready by the worker's last poll of file descriptors */
+	struct uthread_tcb *polled[NETPOLL_BATCH];
+
+	pthread_t pthread;
+} __attribute__((aligned(CACHE_LINE_SIZE)));
+
+/*
+ * Keep the queue of yielded threads global and shared by all the workers. Idle
+ * workers wait on runCond for a thread to become ready, until all of them are
+ * idle at once: no thread can become ready anymore, and runDone is set.
+ *
+ * Bit i of runBitmap is set when runQ[i] is not empty.
+ */
+struct list runQ[PRIO_LEVELS];
+unsigned int runBitmap;
+pthread_mutex_t runLock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t runCond = PTHREAD_COND_INITIALIZER;
+size_t idleWorkers;
+bool runDone;
+
+/* Keep the TCB cache and workers global */
+slab_t tcbCache;
+spinlock_t tcbLock;
+
+/*
+ * Thread identifiers: the low TID_SLOT_BITS bits of an identifier index
+ * tidTable, where the thread is found, and the other bits hold the generation
+ * of the slot, which changes each time the slot is freed so that identifiers of
+ * exited threads match no thread. Free slots are chained through their next
+ * index, from tidFree. All of it is protected by tcbLock, and lasts across runs
+ * so that identifiers are not reused right away.
+ */
+#define TID_SLOT_BITS 32
+#define TID_SLOT_MASK ((1UL << TID_SLOT_BITS) - 1)
+#define TID_GEN_MASK 0x7fffffffUL
+#define TID_NONE UINT32_MAX
+
+struct tid_slot
 {
-	struct node *head;
-	struct node *tail;
+	struct uthread_tcb *thread;
+	uint32_t gen;
+	uint32_t nextFree;
 };
 
-struct uthread_tcb
-{
-	uthread_ctx_t *threadCtx;
-	char *stackPointer;
-	int state;
-};
+static struct tid_slot *tidTable;
+static size_t tidLength;
+static size_t tidCapacity;
+static uint32_t tidFree = TID_NONE;
+struct worker *workers;
+size_t numWorkers;
+
+/*
+ * Scheduling policy configured, policy of the current run, and next time (in
+ * ms) MLFQ boosts demoted threads
+ */
+static uthread_sched_t schedConfig = UTHREAD_SCHED_RR;
+static uthread_sched_t schedPolicy;
+static long mlfqNextBoost;
+
+/*
+ * Ready threads of the fair policy, ordered by virtual runtime. The virtual
+ * runtime of a thread is sampled as its key when it is queued: the thread may
+ * still be running on a worker then, and be charged its last run after the
+ * fact. fairMin is the key of the last thread picked, where woken threads
+ * start from.
+ */
+static struct heap fairQ;
+static uint64_t fairMin;
+
+/*
+ * Threads of the deadline class: the ready ones ordered by absolute deadline,
+ * and the ones waiting for their next period ordered by release time.
+ * edfNextRelease is the earliest release time, 0 if none.
+ */
+static struct heap edfQ;
+static struct heap edfSleepQ;
+static uint64_t edfNextRelease;
+static unsigned long edfMisses;
+
+/*
+ * Threads sleeping in uthread_sleep_until(), and the next time the wheel needs
+ * advancing, 0 if no thread sleeps
+ */
+static struct wheel sleepWheel;
+static uint64_t sleepNextWake;
+
+/*
+ * Destructors of the thread-local keys, and number of keys created (protected
+ * by keyLock); a key is only handed out once its destructor is set, so lookups
+ * read keyCount without the lock
+ */
+static spinlock_t keyLock;
+static void (*keyDestructors[UTHREAD_KEYS_MAX])(void *);
+static int keyCount;
+
+/*
+ * Whether an idle worker is blocked polling the file descriptors threads wait
+ * for (protected by runLock), and next time a busy worker polls them
+ */
+static bool netpollPolling;
+static uint64_t netpollNext;
+
+/* Worker of the calling kernel thread, NULL outside of uthread_run() */
+static __thread struct worker *thisWorker;
+
+/**
+ * @brief Get the worker of the calling kernel thread
+ *
+ * A thread can be resumed by another worker than the one it was running on,
+ * so the address of thisWorker must never be kept across a context switch;
+ * reading it through this non-inlined function prevents the compiler from
+ * caching it.
+ *
+ * @param none
+ * @return struct worker of the calling kernel thread
+ */
+static __attribute__((noinline)) struct worker *this_worker(void)
+{
+	__asm__ __volatile__("" ::: "memory");
+	return thisWorker;
+}
+
+/**
+ * @brief Get the time, for the fair policy and the deadline class
+ *
+ * @param none
+ * @return Monotonic time, in nanoseconds
+ */
+static uint64_t sched_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * @brief Charge a thread for the time it ran since it was last switched to,
+ * scaled by its weight
+ *
+ * @param thread TCB of the thread running on the calling worker
+ * @return none
+ */
+static void fair_charge(struct uthread_tcb *thread)
+{
+	uint64_t ran = sched_now() - thread->runStart;
+
+	__atomic_store_n(&thread->vruntime, thread->vruntime +
+			 ran * UTHREAD_WEIGHT_DEFAULT / thread->weight,
+			 __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Start running a thread picked from the fair policy's heap, once it is
+ * done being charged for its previous run
+ *
+ * @param thread TCB of the thread
+ * @return none
+ */
+static void fair_start(struct uthread_tcb *thread)
+{
+	if(thread->vruntime < thread->fairKey)
+	{
+		thread->vruntime = thread->fairKey;
+	}
+	thread->runStart = sched_now();
+}
+
+/**
+ * @brief Queue a thread in the fair policy's heap, runLock must be held
+ *
+ * @param thread TCB of the thread to queue
+ * @return none
+ */
+static void fair_push(struct uthread_tcb *thread)
+{
+	uint64_t vruntime = __atomic_load_n(&thread->vruntime, __ATOMIC_RELAXED);
+
+	/* Threads that were blocked get no credit for the time they did not run */
+	heap_push(&fairQ, vruntime > fairMin ? vruntime : fairMin, thread);
+}
+
+/**
+ * @brief Dequeue the thread with the lowest virtual runtime from the fair
+ * policy's heap, runLock must be held
+ *
+ * @param none
+ * @return struct uthread_tcb of the thread, NULL if the heap is empty
+ */
+static struct uthread_tcb *fair_pop(void)
+{
+	uint64_t key;
+	struct uthread_tcb *thread = heap_pop(&fairQ, &key);
+
+	if(thread)
+	{
+		fairMin = key;
+		thread->fairKey = key;
+	}
+	return thread;
+}
+
+/**
+ * @brief Make room in the scheduler's heaps for a new thread
+ *
+ * @param fair True if the thread is to be queued by the fair policy
+ * @param edf True if the thread belongs to the deadline class
+ * @return Returns 0 in case of success, -1 in case of memory allocation error
+ */
+static int thread_reserve(bool fair, bool edf)
+{
+	int ret = 0;
+
+	pthread_mutex_lock(&runLock);
+	if(fair && heap_reserve(&fairQ))
+	{
+		ret = -1;
+	}
+	else if(edf && heap_reserve(&edfQ))
+	{
+		ret = -1;
+		if(fair)
+		{
+			heap_unreserve(&fairQ);
+		}
+	}
+	else if(edf && heap_reserve(&edfSleepQ))
+	{
+		ret = -1;
+		heap_unreserve(&edfQ);
+		if(fair)
+		{
+			heap_unreserve(&fairQ);
+		}
+	}
+	pthread_mutex_unlock(&runLock);
+
+	return ret;
+}
+
+/**
+ * @brief Give back the room of a thread in the scheduler's heaps
+ *
+ * @param fair True if the thread was queued by the fair policy
+ * @param edf True if the thread belonged to the deadline class
+ * @return none
+ */
+static void thread_unreserve(bool fair, bool edf)
+{
+	pthread_mutex_lock(&runLock);
+	if(fair)
+	{
+		heap_unreserve(&fairQ);
+	}
+	if(edf)
+	{
+		heap_unreserve(&edfQ);
+		heap_unreserve(&edfSleepQ);
+	}
+	pthread_mutex_unlock(&runLock);
+}
+
+/**
+ * @brief Give a new thread an identifier, tcbLock must be held
+ *
+ * @param thread TCB of the new thread
+ * @return Returns 0 in case of success, -1 in case of memory allocation error
+ */
+static int tid_alloc(struct uthread_tcb *thread)
+{
+	uint32_t slot = tidFree;
+
+	if(slot != TID_NONE)
+	{
+		tidFree = tidTable[slot].nextFree;
+	}
+	else
+	{
+		if(tidLength == tidCapacity)
+		{
+			size_t capacity = tidCapacity ? 2 * tidCapacity : HEAP_INITIAL_SIZE;
+			struct tid_slot *table = NULL;
+
+			if(capacity <= TID_NONE)
+			{
+				table = realloc(tidTable, capacity * sizeof(struct tid_slot));
+			}
+			if(table == NULL)
+			{
+				return -1;
+			}
+			tidTable = table;
+			tidCapacity = capacity;
+		}
+
+		slot = tidLength++;
+		tidTable[slot].gen = 1;
+	}
+
+	tidTable[slot].thread = thread;
+	thread->tid = (uthread_tid_t)tidTable[slot].gen << TID_SLOT_BITS | slot;
+
+	return 0;
+}
+
+/**
+ * @brief Free the identifier of a thread, tcbLock must be held
+ *
+ * @param thread TCB of the thread
+ * @return none
+ */
+static void tid_free(struct uthread_tcb *thread)
+{
+	uint32_t slot = thread->tid & TID_SLOT_MASK;
+
+	/* Generation 0 is never used, so that identifiers are positive */
+	tidTable[slot].thread = NULL;
+	tidTable[slot].gen = (tidTable[slot].gen & TID_GEN_MASK) + 1;
+	tidTable[slot].nextFree = tidFree;
+	tidFree = slot;
+}
+
+/**
+ * @brief Find a thread from its identifier, tcbLock must be held
+ *
+ * @param tid Thread identifier
+ * @return struct uthread_tcb of the thread, NULL if no thread has identifier
+ * @tid
+ */
+static struct uthread_tcb *tid_lookup(uthread_tid_t tid)
+{
+	size_t slot = (unsigned long)tid & TID_SLOT_MASK;
+
+	if(tid <= 0 || slot >= tidLength ||
+	   tidTable[slot].gen != (unsigned long)tid >> TID_SLOT_BITS)
+	{
+		return NULL;
+	}
+
+	return tidTable[slot].thread;
+}
+
+/**
+ * @brief Queue a thread in runQ, at its current priority, runLock must be held
+ *
+ * @param thread TCB of the thread to queue
+ * @return none
+ */
+static void run_queue_push(struct uthread_tcb *thread)
+{
+	if(thread->level == EDF_LEVEL)
+	{
+		heap_push(&edfQ, thread->deadline, thread);
+	}
+	else if(schedPolicy == UTHREAD_SCHED_FAIR)
+	{
+		fair_push(thread);
+	}
+	else
+	{
+		list_push_back(&runQ[thread->level], &thread->link);
+	}
+	__atomic_store_n(&runBitmap, runBitmap | 1u << thread->level,
+			 __ATOMIC_RELAXED);
+
+	if(idleWorkers)
+	{
+		pthread_cond_signal(&runCond);
+	}
+	if(netpollPolling)
+	{
+		netpoll_break();
+	}
+}
+
+/**
+ * @brief Make ready a thread that waited outside of the running threads' reach,
+ * for a timer or a file descriptor, runLock must be held
+ *
+ * @param thread TCB of the thread
+ * @return none
+ */
+static void thread_wake_locked(struct uthread_tcb *thread)
+{
+	/* MLFQ gives the threads that wait their priority back */
+	if(schedPolicy == UTHREAD_SCHED_MLFQ && thread->level != EDF_LEVEL)
+	{
+		thread->level = thread->priority;
+	}
+	thread->state = READY;
+	run_queue_push(thread);
+}
+
+/**
+ * @brief Dequeue the oldest thread of the highest priority in runQ, runLock
+ * must be held
+ *
+ * @param minLevel Lowest priority to look at
+ * @return struct uthread_tcb of the thread, NULL if runQ has no thread of
+ * priority @minLevel or higher
+ */
+static struct uthread_tcb *run_queue_pop(int minLevel)
+{
+	unsigned int ready = runBitmap >> minLevel;
+
+	if(ready == 0)
+	{
+		return NULL;
+	}
+
+	int level = minLevel + 31 - __builtin_clz(ready);
+	struct uthread_tcb *thread = NULL;
+	bool empty = false;
+
+	/* The deadline class and the fair policy queue threads in heaps */
+	if(level == EDF_LEVEL)
+	{
+		thread = heap_pop(&edfQ, NULL);
+		empty = edfQ.length == 0;
+	}
+	else if(schedPolicy == UTHREAD_SCHED_FAIR)
+	{
+		thread = fair_pop();
+		empty = fairQ.length == 0;
+	}
+
+	if(thread)
+	{
+		if(empty)
+		{
+			__atomic_store_n(&runBitmap, runBitmap & ~(1u << level),
+					 __ATOMIC_RELAXED);
+		}
+		return thread;
+	}
+
+	struct list_node *node = list_pop_front(&runQ[level]);
+
+	if(list_length(&runQ[level]) == 0)
+	{
+		__atomic_store_n(&runBitmap, runBitmap & ~(1u << level),
+				 __ATOMIC_RELAXED);
+	}
+
+	return list_entry(node, struct uthread_tcb, link);
+}
+
+/**
+ * @brief Take a thread out of runQ, runLock must be held
+ *
+ * @param thread TCB of the thread
+ * @return Returns true if @thread was in one of runQ's lists, false otherwise
+ */
+static bool run_queue_remove(struct uthread_tcb *thread)
+{
+	/* Threads queued in a deque or a heap cannot be found there in O(1) */
+	if(thread->link.next == NULL)
+	{
+		return false;
+	}
+
+	list_remove(&runQ[thread->level], &thread->link);
+	if(list_length(&runQ[thread->level]) == 0)
+	{
+		__atomic_store_n(&runBitmap, runBitmap & ~(1u << thread->level),
+				 __ATOMIC_RELAXED);
+	}
+
+	return true;
+}
+
+/**
+ * @brief Dequeue the oldest thread of the highest priority in runQ, taking
+ * runLock
+ *
+ * @param minLevel Lowest priority to look at
+ * @return struct uthread_tcb of the thread, NULL if runQ has no thread of
+ * priority @minLevel or higher
+ */
+static struct uthread_tcb *run_queue_take(int minLevel)
+{
+	struct uthread_tcb *thread;
+
+	/* Don't bother locking an empty queue */
+	if((__atomic_load_n(&runBitmap, __ATOMIC_RELAXED) >> minLevel) == 0)
+	{
+		return NULL;
+	}
+
+	pthread_mutex_lock(&runLock);
+	thread = run_queue_pop(minLevel);
+	pthread_mutex_unlock(&runLock);
+
+	return thread;
+}
+
+/**
+ * @brief Give the demoted threads waiting in runQ their priority back, once
+ * every MLFQ_BOOST_INTERVAL
+ *
+ * @param none
+ * @return none
+ */
+static void mlfq_boost(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+	long now = ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+	if(now < __atomic_load_n(&mlfqNextBoost, __ATOMIC_RELAXED))
+	{
+		return;
+	}
+
+	pthread_mutex_lock(&runLock);
+	mlfqNextBoost = now + MLFQ_BOOST_INTERVAL;
+
+	/* Demoted threads are below their own priority, the top level has none */
+	for(int level = 0; level < PRIO_LEVELS - 1; level++)
+	{
+		for(size_t n = list_length(&runQ[level]); n > 0; n--)
+		{
+			struct list_node *node = list_pop_front(&runQ[level]);
+			struct uthread_tcb *thread = list_entry(node, struct uthread_tcb,
+								 link);
+
+			thread->level = thread->priority;
+			list_push_back(&runQ[thread->level], node);
+			runBitmap |= 1u << thread->level;
+		}
+
+		if(list_length(&runQ[level]) == 0)
+		{
+			runBitmap &= ~(1u << level);
+		}
+	}
+	pthread_mutex_unlock(&runLock);
+}
+
+/**
+ * @brief Release the jobs of the threads of the deadline class whose period
+ * has started, runLock must be held
+ *
+ * @param now Current time (in ns)
+ * @return none
+ */
+static void edf_release_locked(uint64_t now)
+{
+	uint64_t release;
+
+	while(heap_min(&edfSleepQ, &release) && release <= now)
+	{
+		struct uthread_tcb *thread = heap_pop(&edfSleepQ, NULL);
+
+		thread->state = READY;
+		run_queue_push(thread);
+	}
+
+	__atomic_store_n(&edfNextRelease,
+			 heap_min(&edfSleepQ, &release) ? release : 0,
+			 __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Wake up the sleeping threads whose time has come, runLock must be
+ * held
+ *
+ * @param now Current time (in ns)
+ * @return none
+ */
+static void sleep_wake_locked(uint64_t now)
+{
+	struct list expired;
+	struct list_node *node;
+	uint64_t wake;
+
+	list_init(&expired);
+	wheel_advance(&sleepWheel, now, &expired);
+
+	while((node = list_pop_front(&expired)))
+	{
+		thread_wake_locked(list_entry(node, struct uthread_tcb,
+					      sleepTimer.link));
+	}
+
+	__atomic_store_n(&sleepNextWake, wheel_next(&sleepWheel, &wake) ? wake : 0,
+			 __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Get the next time a thread waiting for time to pass becomes ready,
+ * whether of the deadline class or sleeping
+ *
+ * @param none
+ * @return Time (in ns), 0 if no thread is waiting
+ */
+static uint64_t sched_next_timer(void)
+{
+	uint64_t release = __atomic_load_n(&edfNextRelease, __ATOMIC_RELAXED);
+	uint64_t wake = __atomic_load_n(&sleepNextWake, __ATOMIC_RELAXED);
+
+	if(release == 0 || (wake && wake < release))
+	{
+		return wake;
+	}
+	return release;
+}
+
+/**
+ * @brief Make ready the threads waiting for a time that has come, runLock must
+ * be held
+ *
+ * @param now Current time (in ns)
+ * @return none
+ */
+static void sched_timers_locked(uint64_t now)
+{
+	if(edfNextRelease)
+	{
+		edf_release_locked(now);
+	}
+	if(sleepNextWake)
+	{
+		sleep_wake_locked(now);
+	}
+}
+
+/**
+ * @brief Poll the file descriptors threads wait for, and make ready the threads
+ * whose file descriptor is
+ *
+ * @param worker Worker of the calling kernel thread
+ * @param timeout Most time to wait (in ns), 0 not to wait, -1 for no limit
+ * @return none
+ */
+static void sched_netpoll(struct worker *worker, int64_t timeout)
+{
+	size_t count = netpoll_poll(timeout, worker->polled);
+
+	if(count)
+	{
+		pthread_mutex_lock(&runLock);
+		for(size_t i = 0; i < count; i++)
+		{
+			thread_wake_locked(worker->polled[i]);
+		}
+		pthread_mutex_unlock(&runLock);
+	}
+}
+
+/**
+ * @brief Run the parts of the scheduler that depend on time: MLFQ boosts,
+ * releases of the deadline class, sleeping threads waking up, and polls of
+ * file descriptors when workers are too busy to poll them while idle
+ *
+ * @param none
+ * @return none
+ */
+static void sched_update(void)
+{
+	if(schedPolicy == UTHREAD_SCHED_MLFQ)
+	{
+		mlfq_boost();
+	}
+
+	uint64_t next = sched_next_timer();
+	if(next && sched_now() >= next)
+	{
+		pthread_mutex_lock(&runLock);
+		sched_timers_locked(sched_now());
+		pthread_mutex_unlock(&runLock);
+	}
+
+	/*
+	 * Submit the ring requests the threads queued with a single system call,
+	 * once they are worth it, rather than waiting for the next poll
+	 */
+	if(uring_submit_due())
+	{
+		uring_submit();
+	}
+
+	if(netpoll_pending())
+	{
+		uint64_t now = sched_now();
+		uint64_t poll = __atomic_load_n(&netpollNext, __ATOMIC_RELAXED);
+
+		/* One worker at a time */
+		if(now >= poll &&
+		   __atomic_compare_exchange_n(&netpollNext, &poll,
+					       now + NETPOLL_INTERVAL, false,
+					       __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		{
+			sched_netpoll(this_worker(), 0);
+		}
+	}
+}
+
+/**
+ * @brief Wake up an idle worker if there is one, after pushing a thread on a
+ * deque
+ *
+ * @param none
+ * @return none
+ */
+static void wake_idle_worker(void)
+{
+	/* Pairs with the fence in worker_wait() */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+	if(__atomic_load_n(&idleWorkers, __ATOMIC_RELAXED))
+	{
+		pthread_mutex_lock(&runLock);
+		pthread_cond_signal(&runCond);
+		if(netpollPolling)
+		{
+			netpoll_break();
+		}
+		pthread_mutex_unlock(&runLock);
+	}
+}
+
+/**
+ * @brief Make a thread ready to run, preemption must be disabled
+ *
+ * @param worker Worker of the calling kernel thread, NULL if none
+ * @param thread TCB of the thread to make ready
+ * @return none
+ */
+static void thread_ready(struct worker *worker, struct uthread_tcb *thread)
+{
+	thread->state = READY;
+
+	/* The running thread now has someone to be preempted for */
+	if(worker && worker->current &&
+	   (thread->level >= worker->current->level ||
+	    schedPolicy == UTHREAD_SCHED_MLFQ))
+	{
+		preempt_tick(true);
+	}
+
+	if(worker && numWorkers > 1 && schedPolicy != UTHREAD_SCHED_FAIR &&
+	   thread->level == UTHREAD_PRIO_DEFAULT &&
+	   deque_push(&worker->deque, thread) == 0)
+	{
+		wake_idle_worker();
+		return;
+	}
+
+	pthread_mutex_lock(&runLock);
+	run_queue_push(thread);
+	pthread_mutex_unlock(&runLock);
+}
+
+/**
+ * @brief Check whether a worker has other threads to run than the one it is
+ * about to run
+ *
+ * @param worker Worker of the calling kernel thread
+ * @param level Priority of the thread about to run
+ * @return Returns true if runQ or the deque of @worker holds threads of
+ * priority @level or higher
+ */
+static bool others_ready(struct worker *worker, int level)
+{
+	/*
+	 * With MLFQ, lower priority threads only get to run once the threads above
+	 * them are demoted or they get boosted, so they count too
+	 */
+	if(schedPolicy == UTHREAD_SCHED_MLFQ)
+	{
+		level = UTHREAD_PRIO_MIN;
+	}
+
+	return (__atomic_load_n(&runBitmap, __ATOMIC_RELAXED) >> level) ||
+		(level <= UTHREAD_PRIO_DEFAULT && !deque_empty(&worker->deque));
+}
+
+/**
+ * @brief Set the preemption timer of a worker for the thread it is about to
+ * run, or keeps running, preemption must be disabled
+ *
+ * @param worker Worker of the calling kernel thread
+ * @param level Priority of the thread
+ * @return none
+ */
+static void thread_slice(struct worker *worker, int level)
+{
+	bool needed = others_ready(worker, level);
+
+	/*
+	 * MLFQ demotes the threads that use up their time slice, so each thread
+	 * gets its own slice instead of what is left of the previous thread's
+	 */
+	if(schedPolicy == UTHREAD_SCHED_MLFQ)
+	{
+		preempt_restart(needed);
+	}
+	else
+	{
+		preempt_tick(needed);
+	}
+
+	/*
+	 * Interrupt the thread when the next job of the deadline class is due, or
+	 * the next sleeping thread wakes up
+	 */
+	uint64_t release = sched_next_timer();
+	if(release)
+	{
+		preempt_release(release);
+	}
+}
+
+/**
+ * @brief Steal a thread from the deque of another worker
+ *
+ * @param worker Worker of the calling kernel thread
+ * @return struct uthread_tcb of the stolen thread, NULL if none was found
+ */
+static struct uthread_tcb *thread_steal(struct worker *worker)
+{
+	size_t n = numWorkers;
+
+	/* Start from a random victim, so that thieves spread out */
+	worker->stealSeed = worker->stealSeed * 1103515245 + 12345;
+	size_t first = (worker->stealSeed >> 16) % n;
+
+	for(size_t i = 0; i < n; i++)
+	{
+		struct worker *victim = &workers[(first + i) % n];
+
+		if(victim == worker)
+		{
+			continue;
+		}
+
+		struct uthread_tcb *thread = deque_steal(&victim->deque);
+		if(thread)
+		{
+			return thread;
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Pick the next thread for a worker to run, preemption must be
+ * disabled
+ *
+ * @param worker Worker of the calling kernel thread
+ * @param minLevel Lowest priority of the threads to consider
+ * @return struct uthread_tcb of the thread to run, NULL if none was found
+ */
+static struct uthread_tcb *thread_pick(struct worker *worker, int minLevel)
+{
+	struct uthread_tcb *thread = NULL;
+
+	sched_update();
+
+	if(numWorkers == 1 || schedPolicy == UTHREAD_SCHED_FAIR)
+	{
+		return run_queue_take(minLevel);
+	}
+
+	/* Threads of a higher priority than deques hold always go first */
+	if(minLevel <= UTHREAD_PRIO_DEFAULT)
+	{
+		thread = run_queue_take(UTHREAD_PRIO_DEFAULT + 1);
+	}
+	if(thread || minLevel > UTHREAD_PRIO_DEFAULT)
+	{
+		return thread ? thread : run_queue_take(minLevel);
+	}
+
+	/* Own deque first, but look at runQ now and then so it does not starve */
+	if(++worker->schedTick % RUNQ_CHECK_INTERVAL != 0)
+	{
+		thread = deque_take(&worker->deque);
+	}
+	if(thread == NULL)
+	{
+		thread = run_queue_take(minLevel);
+	}
+	if(thread == NULL)
+	{
+		thread = deque_take(&worker->deque);
+	}
+	if(thread == NULL)
+	{
+		thread = thread_steal(worker);
+	}
+
+	return thread;
+}
+
+/**
+ * @brief Check for ready threads anywhere, runLock must be held
+ *
+ * @param none
+ * @return Returns true if some thread is ready to run
+ */
+static bool work_available(void)
+{
+	if(runBitmap)
+	{
+		return true;
+	}
+
+	for(size_t i = 0; i < numWorkers; i++)
+	{
+		if(!deque_empty(&workers[i].deque))
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/**
+ * @brief Wait for a thread to become ready, when a worker found none
+ *
+ * @param worker Worker of the calling kernel thread
+ * @return Returns false once no thread can become ready anymore, true
+ * otherwise
+ */
+static bool worker_wait(struct worker *worker)
+{
+	bool done;
+
+	pthread_mutex_lock(&runLock);
+	__atomic_add_fetch(&idleWorkers, 1, __ATOMIC_SEQ_CST);
+
+	/* Look again, now that whoever makes a thread ready will wake us up */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	sched_timers_locked(sched_now());
+	if(!runDone && !work_available())
+	{
+		uint64_t next = sched_next_timer();
+
+		/*
+		 * Nothing left to run if no other worker is running a thread, and no
+		 * thread is waiting for its next period, sleeping or waiting for a file
+		 * descriptor. Otherwise block until the next of them is due.
+		 */
+		if(idleWorkers == numWorkers && edfSleepQ.length == 0 &&
+		   sleepWheel.length == 0 && !netpoll_pending() && !netpollPolling)
+		{
+			runDone = true;
+			pthread_cond_broadcast(&runCond);
+		}
+		else if(netpoll_pending() && !netpollPolling)
+		{
+			/*
+			 * One idle worker waits for file descriptors instead, interrupted
+			 * by whoever makes a thread ready
+			 */
+			uint64_t now = sched_now();
+
+			netpollPolling = true;
+			pthread_mutex_unlock(&runLock);
+			sched_netpoll(worker, next == 0 ? -1 :
+				      next > now ? (int64_t)(next - now) : 0);
+			pthread_mutex_lock(&runLock);
+			netpollPolling = false;
+		}
+		else if(next)
+		{
+			/* The condition variable waits on the realtime clock */
+			uint64_t now = sched_now();
+			uint64_t delay = next > now ? next - now : 0;
+			struct timespec ts;
+
+			clock_gettime(CLOCK_REALTIME, &ts);
+			delay += ts.tv_nsec;
+			ts.tv_sec += delay / 1000000000;
+			ts.tv_nsec = delay % 1000000000;
+			pthread_cond_timedwait(&runCond, &runLock, &ts);
+		}
+		else
+		{
+			pthread_cond_wait(&runCond, &runLock);
+		}
+	}
+
+	__atomic_sub_fetch(&idleWorkers, 1, __ATOMIC_SEQ_CST);
+	done = runDone;
+	pthread_mutex_unlock(&runLock);
+
+	return !done;
+}
+
+/**
+ * @brief Get the identifier of the current running thread
+ *
+ * @param none
+ * @return uthread_tid_t - Identifier of the current running thread, -1 if
+ * none
+ */
+uthread_tid_t uthread_self(void)
+{
+	struct uthread_tcb *currThread = uthread_current();
+
+	return currThread ? currThread->tid : -1;
+}
+
+/**
+ * @brief Get current running thread
+ *
+ * @param none
+ * @return struct uthread_tcb of the current running thread
+ */
+struct uthread_tcb *uthread_current(void)
+{
+	struct worker *worker = this_worker();
+
+	return worker ? worker->current : NULL;
+}
+
+/**
+ * @brief Mark a thread as running, once the worker it last ran on is done
+ * saving its context
+ *
+ * @param thread TCB of the thread about to be switched to
+ * @return none
+ */
+static void thread_claim(struct uthread_tcb *thread)
+{
+	unsigned int spins = 0;
+
+	while(__atomic_load_n(&thread->onCpu, __ATOMIC_ACQUIRE))
+	{
+		/*
+		 * With more workers than CPUs, the worker saving the thread may not
+		 * be running at all, so let it have the CPU
+		 */
+		if(++spins % CLAIM_SPINS == 0)
+		{
+			sched_yield();
+		}
+		else
+		{
+			cpu_relax();
+		}
+	}
+
+	thread->onCpu = 1;
+	thread->state = RUNNING;
+
+	if(schedPolicy == UTHREAD_SCHED_FAIR)
+	{
+		fair_start(thread);
+	}
+}
+
+/**
+ * @brief Free the TCB and identifier of a thread that is gone, tcbLock must be
+ * held
+ *
+ * @param thread TCB of the thread to free
+ * @return none
+ */
+static void thread_free(struct uthread_tcb *thread)
+{
+	tid_free(thread);
+	slab_free(tcbCache, thread);
+}
+
+/**
+ * @brief Free the stack of an exited thread, and its TCB unless it waits to be
+ * joined, preemption must be disabled
+ *
+ * @param worker Worker of the calling kernel thread
+ * @param thread TCB of the thread to free
+ * @return none
+ */
+static void thread_destroy(struct worker *worker, struct uthread_tcb *thread)
+{
+	uthread_ctx_destroy_stack(thread->stackPointer, thread->stackSize,
+				  thread->guardSize);
+
+	if(schedPolicy == UTHREAD_SCHED_FAIR || thread->period)
+	{
+		thread_unreserve(schedPolicy == UTHREAD_SCHED_FAIR, thread->period);
+	}
+
+	/* Hand the return value to the joining thread, if it already waits */
+	spin_lock(&tcbLock);
+	struct uthread_join *joiner = thread->joiner;
+	if(joiner)
+	{
+		joiner->retval = thread->retval;
+	}
+	if(joiner || thread->detached)
+	{
+		thread_free(thread);
+	}
+	else
+	{
+		thread->zombie = true;
+	}
+	spin_unlock(&tcbLock);
+
+	if(joiner)
+	{
+		/* MLFQ gives the threads that wait their priority back */
+		if(schedPolicy == UTHREAD_SCHED_MLFQ &&
+		   joiner->thread->level != EDF_LEVEL)
+		{
+			joiner->thread->level = joiner->thread->priority;
+		}
+		thread_ready(worker, joiner->thread);
+	}
+}
+
+/**
+ * @brief Release the thread the calling worker switched away from, or free it
+ * if it exited
+ *
+ * @param none
+ * @return none
+ */
+void uthread_switch_finish(void)
+{
+	struct worker *worker = this_worker();
+	struct uthread_tcb *prev = worker ? worker->prev : NULL;
+
+	/* Contexts can also be switched outside of uthread_run(), without TCBs */
+	if(prev)
+	{
+		worker->prev = NULL;
+
+		/*
+		 * An exited thread switches straight to the next thread, which frees
+		 * it now that it runs on another stack
+		 */
+		if(prev->state == EXITED)
+		{
+			thread_destroy(worker, prev);
+			return;
+		}
+
+		__atomic_store_n(&prev->onCpu, 0, __ATOMIC_RELEASE);
+
+		if(worker->readyPrev)
+		{
+			worker->readyPrev = false;
+			thread_ready(worker, prev);
+		}
+	}
+}
+
+/**
+ * @brief Switch from the current thread to another one, preemption must be
+ * disabled
+ *
+ * @param worker Worker of the calling kernel thread
+ * @param prev TCB of the current thread, already queued wherever it is to be
+ * resumed from
+ * @param next TCB of the thread to switch to, NULL for the idle context
+ * @return none
+ */
+static void uthread_switch(struct worker *worker, struct uthread_tcb *prev,
+			   struct uthread_tcb *next)
+{
+	worker->prev = prev;
+	worker->current = next;
+
+	if(next == NULL)
+	{
+		preempt_tick(false);
+		uthread_ctx_switch(&prev->ctx, &worker->idleCtx);
+	}
+	else
+	{
+		thread_slice(worker, next->level);
+		thread_claim(next);
+		uthread_ctx_switch(&prev->ctx, &next->ctx);
+	}
+
+	/* Resumed, possibly by another worker */
+	uthread_switch_finish();
+}
+
+/**
+ * @brief Idle loop of a worker, runs threads until none is left
+ *
+ * @param worker Worker of the calling kernel thread
+ * @return none
+ */
+static void worker_loop(struct worker *worker)
+{
+	struct uthread_tcb *currThread;
+
+	/* The idle context always runs with preemption disabled */
+	preempt_disable();
+	preempt_thread_start();
+
+	/* Begin infinite loop, break when no more threads can become ready */
+	while(1)
+	{
+		currThread = thread_pick(worker, UTHREAD_PRIO_MIN);
+		if(currThread == NULL)
+		{
+			if(!worker_wait(worker))
+			{
+				break;
+			}
+			continue;
+		}
+
+		worker->current = currThread;
+		thread_slice(worker, currThread->level);
+		thread_claim(currThread);
+		uthread_ctx_switch(&worker->idleCtx, &currThread->ctx);
+
+		/* Back to idle, the thread running on this worker blocked or exited */
+		uthread_switch_finish();
+	}
+
+	preempt_thread_stop();
+}
+
+/**
+ * @brief Entry point of the kernel threads of the additional workers
+ *
+ * @param arg Worker of the new kernel thread
+ * @return NULL
+ */
+static void *worker_main(void *arg)
+{
+	thisWorker = arg;
+	worker_loop(arg);
+
+	return NULL;
+}
+
+/**
+ * @brief Free the TCB cache and the workers
+ *
+ * @param cache TCB cache, may be NULL
+ * @param ndeques Number of workers with an initialized deque
+ * @return none
+ */
+static void uthread_release(slab_t cache, size_t ndeques)
+{
+	for(size_t i = 0; i < ndeques; i++)
+	{
+		deque_destroy(&workers[i].deque);
+	}
+
+	/* Threads left blocked or unjoined are gone with the TCB cache */
+	for(size_t i = 0; i < tidLength; i++)
+	{
+		if(tidTable[i].thread)
+		{
+			tid_free(tidTable[i].thread);
+		}
+	}
+
+	free(workers);
+	slab_destroy(cache);
+
+	heap_destroy(&fairQ);
+	heap_destroy(&edfQ);
+	heap_destroy(&edfSleepQ);
+}
+
+/**
+ * @brief Runs the multithreading library on several kernel threads
+ *
+ * @param nworkers Number of kernel threads running threads, 0 for one per CPU
+ * @param preempt Boolean value to enable preemption
+ * @param func Function of the first thread to start
+ * @param arg Arguments to be passed to the first thread
+ * @return int - 0 in case of success, -1 in case of failure
+ */
+int uthread_run_workers(size_t nworkers, bool preempt, uthread_func_t func,
+			void *arg)
+{
+	if(nworkers == 0)
+	{
+		long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		nworkers = cpus > 0 ? cpus : 1;
+	}
+
+	/* Initialize queues */
+	for(int level = 0; level < PRIO_LEVELS; level++)
+	{
+		list_init(&runQ[level]);
+	}
+	runBitmap = 0;
+	schedPolicy = schedConfig;
+	mlfqNextBoost = 0;
+	fairMin = 0;
+	edfNextRelease = 0;
+	edfMisses = 0;
+	wheel_init(&sleepWheel, sched_now());
+	sleepNextWake = 0;
+	netpollPolling = false;
+	netpollNext = 0;
+	idleWorkers = 0;
+	runDone = false;
+	numWorkers = 0;
+	tcbCache = slab_create(sizeof(struct uthread_tcb), CACHE_LINE_SIZE);
+	workers = aligned_alloc(CACHE_LINE_SIZE, nworkers * sizeof(struct worker));
+
+	if(workers)
+	{
+		memset(workers, 0, nworkers * sizeof(struct worker));
+		while(numWorkers < nworkers &&
+		      deque_init(&workers[numWorkers].deque) == 0)
+		{
+			workers[numWorkers].stealSeed = numWorkers + 1;
+			numWorkers++;
+		}
+	}
+
+	/* Create initial thread, the first worker to go idle runs it */
+	if(tcbCache == NULL || numWorkers < nworkers ||
+	   heap_init(&fairQ, HEAP_INITIAL_SIZE) ||
+	   heap_init(&edfQ, HEAP_INITIAL_SIZE) ||
+	   heap_init(&edfSleepQ, HEAP_INITIAL_SIZE) ||
+	   uthread_create(func, arg) < 0)
+	{
+		uthread_release(tcbCache, numWorkers);
+		return -1;
+	}
+
+	/* If we are in preemptive mode */
+	if(preempt)
+	{
+		preempt_start(true);
+	}
+
+	/*
+	 * The calling kernel thread is the first worker, the others disable
+	 * preemption for themselves as soon as they start.
+	 */
+	preempt_disable();
+	thisWorker = &workers[0];
+	for(size_t i = 1; i < nworkers; i++)
+	{
+		if(pthread_create(&workers[i].pthread, NULL, worker_main, &workers[i]))
+		{
+			/* Carry on with the workers we have */
+			pthread_mutex_lock(&runLock);
+			numWorkers = i;
+			pthread_cond_broadcast(&runCond);
+			pthread_mutex_unlock(&runLock);
+			break;
+		}
+	}
+
+	worker_loop(&workers[0]);
+
+	for(size_t i = 1; i < numWorkers; i++)
+	{
+		pthread_join(workers[i].pthread, NULL);
+	}
+	thisWorker = NULL;
+
+	/* Give back the TCBs, workers and pooled stacks */
+	uthread_release(tcbCache, nworkers);
+	uthread_ctx_release_stacks();
+
+	/* Restore timer and sigaction configurations */
+	if(preempt)
+	{
+		preempt_stop();
+	}
+	preempt_enable();
+
+	return 0;
+}
+
+/**
+ * @brief Runs the multithreading library
+ *
+ * @param preempt Boolean value to enable preemption
+ * @param func Function of the first thread to start
+ * @param arg Arguments to be passed to the first thread
+ * @return int - 0 in case of success, -1 in case of failure
+ */
+int uthread_run(bool preempt, uthread_func_t func, void *arg)
+{
+	return uthread_run_workers(1, preempt, func, arg);
+}
+
+/**
+ * @brief Queue the current thread and switch to the first ready thread, which
+ * may be the current thread itself, preemption must be disabled
+ *
+ * Used when the thread's place in the queue depends on how long it ran (fair
+ * policy) or on its deadline (deadline class), rather than on the order of
+ * arrival.
+ *
+ * @param worker Worker of the calling kernel thread
+ * @param thread TCB of the current thread
+ * @return none
+ */
+static void thread_requeue(struct worker *worker, struct uthread_tcb *thread)
+{
+	struct uthread_tcb *newThread;
+
+	if(schedPolicy == UTHREAD_SCHED_FAIR)
+	{
+		fair_charge(thread);
+	}
+	sched_update();
+
+	pthread_mutex_lock(&runLock);
+	thread->state = READY;
+	run_queue_push(thread);
+	newThread = run_queue_pop(UTHREAD_PRIO_MIN);
+	pthread_mutex_unlock(&runLock);
+
+	/* Still the one to run first, carry on with a new time slice */
+	if(newThread == thread)
+	{
+		thread->state = RUNNING;
+		if(schedPolicy == UTHREAD_SCHED_FAIR)
+		{
+			fair_start(thread);
+		}
+		thread_slice(worker, thread->level);
+		return;
+	}
+
+	/* Someone else may have picked the thread, and left nothing to run */
+	uthread_switch(worker, thread, newThread);
+}
+
+/**
+ * @brief Yield to the next thread of the same priority or higher
+ *
+ * @param expired True if the current thread used up its time slice
+ * @return none
+ */
+static void thread_yield(bool expired)
+{
+	/*
+	 * Preemption stays disabled until the context switch is complete, and is
+	 * re-enabled by whichever thread resumes on the other side of it
+	 */
+	preempt_disable();
+
+	struct worker *worker = this_worker();
+	struct uthread_tcb *yieldingThread = worker ? worker->current : NULL;
+	struct uthread_tcb *newThread = NULL;
+
+	if(yieldingThread && (schedPolicy == UTHREAD_SCHED_FAIR ||
+			      yieldingThread->level == EDF_LEVEL))
+	{
+		thread_requeue(worker, yieldingThread);
+		preempt_enable();
+		return;
+	}
+
+	/* If no other thread is ready, then we have no threads to yield to */
+	if(yieldingThread)
+	{
+		/* MLFQ demotes the threads that keep the CPU for a whole slice */
+		if(expired && schedPolicy == UTHREAD_SCHED_MLFQ &&
+		   yieldingThread->level > UTHREAD_PRIO_MIN)
+		{
+			yieldingThread->level--;
+		}
+
+		newThread = thread_pick(worker, yieldingThread->level);
+	}
+
+	/* Yielding threads always go to the back of runQ */
+	if(newThread)
+	{
+		pthread_mutex_lock(&runLock);
+		yieldingThread->state = READY;
+		run_queue_push(yieldingThread);
+		pthread_mutex_unlock(&runLock);
+
+		uthread_switch(worker, yieldingThread, newThread);
+	}
+	else if(yieldingThread && (schedPolicy == UTHREAD_SCHED_MLFQ ||
+				   sched_next_timer()))
+	{
+		/*
+		 * Yielding gives up the rest of the slice, even with no switch, and
+		 * the timer may have fired ahead of a release or a wake up
+		 */
+		thread_slice(worker, yieldingThread->level);
+	}
+	preempt_enable();
+}
+
+/**
+ * @brief Current running thread can yield for other threads to execute
+ *
+ * @param none
+ * @return none
+ */
+void uthread_yield(void)
+{
+	thread_yield(false);
+}
+
+/**
+ * @brief Yield to a specific ready thread
+ *
+ * @param tid Identifier of the thread to run next
+ * @return int - 0 in case of success, -1 if @tid is not a thread waiting in
+ * runQ
+ */
+int uthread_yield_to(uthread_tid_t tid)
+{
+	preempt_disable();
+
+	struct worker *worker = this_worker();
+	struct uthread_tcb *currThread = worker ? worker->current : NULL;
+	struct uthread_tcb *newThread = NULL;
+
+	/*
+	 * The thread cannot exit while it waits in runQ, and cannot be freed while
+	 * tcbLock is held, so it is kept held until the thread is taken out of
+	 * runQ
+	 */
+	if(currThread)
+	{
+		pthread_mutex_lock(&runLock);
+		spin_lock(&tcbLock);
+		newThread = tid_lookup(tid);
+		if(newThread && !run_queue_remove(newThread))
+		{
+			newThread = NULL;
+		}
+		spin_unlock(&tcbLock);
+
+		/* The current thread goes to the back of runQ, as when yielding */
+		if(newThread)
+		{
+			currThread->state = READY;
+			run_queue_push(currThread);
+		}
+		pthread_mutex_unlock(&runLock);
+	}
+
+	if(newThread == NULL)
+	{
+		preempt_enable();
+		return -1;
+	}
+
+	uthread_switch(worker, currThread, newThread);
+	preempt_enable();
+
+	return 0;
+}
+
+/**
+ * @brief Yield on behalf of the preemption timer
+ *
+ * @param none
+ * @return none
+ */
+void uthread_preempt(void)
+{
+	thread_yield(true);
+}
+
+/**
+ * @brief Make a new or unblocked thread ready, and let it run right away if it
+ * has a higher priority than the current thread, preemption must be disabled
+ *
+ * @param thread TCB of the thread to make ready
+ * @return none
+ */
+static void thread_wake(struct uthread_tcb *thread)
+{
+	struct worker *worker = this_worker();
+	struct uthread_tcb *currThread = worker ? worker->current : NULL;
+	bool higher = currThread && (thread->level > currThread->level ||
+				     (thread->level == EDF_LEVEL &&
+				      currThread->level == EDF_LEVEL &&
+				      thread->deadline < currThread->deadline));
+
+	thread_ready(worker, thread);
+	preempt_enable();
+
+	if(higher)
+	{
+		uthread_yield();
+	}
+}
+
+/**
+ * @brief Change the priority of the current running thread
+ *
+ * @param priority New priority
+ * @return int - 0 in case of success, -1 in case of failure
+ */
+int uthread_set_priority(int priority)
+{
+	struct uthread_tcb *currThread = uthread_current();
+
+	if(currThread == NULL || priority < UTHREAD_PRIO_MIN ||
+	   priority > UTHREAD_PRIO_MAX)
+	{
+		return -1;
+	}
+
+	/*
+	 * The fair policy runs all the threads at the default priority, and the
+	 * deadline class above all priorities
+	 */
+	if(schedPolicy == UTHREAD_SCHED_FAIR || currThread->level == EDF_LEVEL)
+	{
+		currThread->priority = priority;
+		return 0;
+	}
+
+	bool lowered = priority < currThread->level;
+	currThread->priority = priority;
+	currThread->level = priority;
+
+	/* Let the threads that now come first run */
+	if(lowered)
+	{
+		uthread_yield();
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Configure the scheduling policy
+ *
+ * @param policy Scheduling policy
+ * @return int - 0 in case of success, -1 if @policy is invalid
+ */
+int uthread_set_sched(uthread_sched_t policy)
+{
+	if(policy != UTHREAD_SCHED_RR && policy != UTHREAD_SCHED_MLFQ &&
+	   policy != UTHREAD_SCHED_FAIR)
+	{
+		return -1;
+	}
+
+	schedConfig = policy;
+	return 0;
+}
+
+/**
+ * @brief Get the slot of a thread-local key in a thread
+ *
+ * @param thread TCB of the thread
+ * @param key Valid key
+ * @return void** - Slot of @key, NULL if it is in the overflow table and the
+ * thread has none
+ */
+static inline void **specific_slot(struct uthread_tcb *thread, uthread_key_t key)
+{
+	if(key < SPECIFIC_INLINE)
+	{
+		return &thread->specific[key];
+	}
+	if(thread->specificOverflow == NULL)
+	{
+		return NULL;
+	}
+	return &thread->specificOverflow[key - SPECIFIC_INLINE];
+}
+
+/**
+ * @brief Run the destructors of the thread-local keys of the current thread,
+ * and free its overflow table
+ *
+ * @param thread TCB of the current thread
+ * @return none
+ */
+static void specific_destroy(struct uthread_tcb *thread)
+{
+	int count = __atomic_load_n(&keyCount, __ATOMIC_ACQUIRE);
+
+	/* Destructors may set values again, go over the keys until none is left */
+	for(int round = 0; round < SPECIFIC_DESTRUCTOR_ROUNDS; round++)
+	{
+		bool called = false;
+
+		for(uthread_key_t key = 0; key < count; key++)
+		{
+			void **slot = specific_slot(thread, key);
+			if(slot == NULL || *slot == NULL || keyDestructors[key] == NULL)
+			{
+				continue;
+			}
+
+			void *value = *slot;
+			*slot = NULL;
+			keyDestructors[key](value);
+			called = true;
+		}
+
+		if(!called)
+		{
+			break;
+		}
+	}
 
-/* Keep the queue of threads and idleThread context global */
-queue_t threadQ;
-uthread_ctx_t ctx[1];
+	free(thread->specificOverflow);
+	thread->specificOverflow = NULL;
+}
 
 /**
- * @brief queue_funct_t Helper function, prints out state's of given queue starting from head end
+ * @brief Exit from the current running thread
  *
- * @param q Queue whose state's we want printed
- * @param data The current node we are at in the queue
+ * @param retval Return value of the thread
  * @return none
  */
-void printQ(queue_t q, void *data)
+void uthread_exit(void *retval)
 {
-        if(q){}
-        struct uthread_tcb *curNode = data;
+	if(uthread_current() == NULL)
+	{
+		exit(0);
+	}
+
+	/* Destructors run on the thread's stack, like the rest of its code */
+	specific_destroy(uthread_current());
 
-        printf("state: %d\n", curNode->state);
+	/*
+	 * Go straight to the next thread, or to the worker's idle context if there
+	 * is none, which frees this one once it has switched out
+	 */
+	preempt_disable();
+
+	struct worker *worker = this_worker();
+	struct uthread_tcb *currThread = worker->current;
+
+	currThread->retval = retval;
+	currThread->state = EXITED;
+	uthread_switch(worker, currThread, thread_pick(worker, UTHREAD_PRIO_MIN));
+
+	exit(0);
 }
 
 /**
- * @brief Get current running thread
+ * @brief Wait for a thread to exit, and free it
  *
- * @param none
- * @return struct uthread_tcb of the current running thread
+ * @param tid Identifier of the thread to wait for
+ * @param retval Set to the return value of the thread, may be NULL
+ * @return int - 0 in case of success, -1 if @tid cannot be joined
  */
-struct uthread_tcb *uthread_current(void)
+int uthread_join(uthread_tid_t tid, void **retval)
 {
-	return threadQ->head->data;
+	preempt_disable();
+
+	struct uthread_tcb *currThread = uthread_current();
+	struct uthread_join join = { .thread = currThread, .retval = NULL };
+
+	if(currThread == NULL)
+	{
+		preempt_enable();
+		return -1;
+	}
+
+	spin_lock(&tcbLock);
+	struct uthread_tcb *thread = tid_lookup(tid);
+	if(thread == NULL || thread == currThread || thread->detached ||
+	   thread->joiner)
+	{
+		spin_unlock(&tcbLock);
+		preempt_enable();
+		return -1;
+	}
+
+	/* Already exited, nothing to wait for */
+	if(thread->zombie)
+	{
+		join.retval = thread->retval;
+		thread_free(thread);
+		spin_unlock(&tcbLock);
+		preempt_enable();
+	}
+	else
+	{
+		/* The thread's worker unblocks us once it has switched away from it */
+		thread->joiner = &join;
+		spin_unlock(&tcbLock);
+		uthread_block();
+	}
+
+	if(retval)
+	{
+		*retval = join.retval;
+	}
+	return 0;
 }
 
 /**
- * @brief Runs the multithreading library
+ * @brief Detach a thread, so that it is freed as soon as it exits
  *
- * @param preempt Boolean value to enable preemption
- * @param func Function of the first thread to start
- * @param arg Arguments to be passed to the first thread
- * @return int - 0 in case of success, -1 in case of failure
+ * @param tid Identifier of the thread to detach
+ * @return int - 0 in case of success, -1 if @tid cannot be detached
  */
-int uthread_run(bool preempt, uthread_func_t func, void *arg)
+int uthread_detach(uthread_tid_t tid)
 {
-	threadQ = queue_create(); /* Initialize queue */
+	int ret = 0;
 
-	/* Create and ctx_switch to initial thread */
-	uthread_create(func, arg);
-	struct uthread_tcb *initThread = threadQ->head->data;
-	initThread->state = RUNNING;
+	preempt_disable();
+	spin_lock(&tcbLock);
 
-	/* If we are in preemptive mode */
-	if(preempt)
+	struct uthread_tcb *thread = tid_lookup(tid);
+	if(thread == NULL || thread->detached || thread->joiner)
 	{
-		preempt_start(true);
+		ret = -1;
+	}
+	else if(thread->zombie)
+	{
+		thread_free(thread);
+	}
+	else
+	{
+		thread->detached = true;
 	}
 
-	uthread_ctx_switch(&ctx[0], initThread->threadCtx);
+	spin_unlock(&tcbLock);
+	preempt_enable();
 
-	/* Begin infinite loop, break when no more threads ready to run */
-	struct uthread_tcb *currThread;
+	return ret;
+}
 
-	while(1)
-	{
-		void *popped;
+/**
+ * @brief Wait for the next period of the current thread, of the deadline class
+ *
+ * @param none
+ * @return int - Number of deadlines missed since the last call, -1 if the
+ * current thread is not of the deadline class
+ */
+int uthread_wait_period(void)
+{
+	preempt_disable();
 
-		preempt_disable();
-		if(queue_dequeue(threadQ, &popped) == -1) /* If dequeue fails */
-		{
-			break;
-		}
+	struct worker *worker = this_worker();
+	struct uthread_tcb *currThread = worker ? worker->current : NULL;
+
+	if(currThread == NULL || currThread->period == 0)
+	{
 		preempt_enable();
+		return -1;
+	}
 
-		currThread = popped;
+	/* The job is done, was it in time? */
+	uint64_t now = sched_now();
+	int missed = now > currThread->deadline;
 
-		/* If currThread finished, free allocated memory */
-		if(currThread->state == EXITED)
-		{
-			uthread_ctx_destroy_stack(currThread->stackPointer);
-			free(currThread->threadCtx);
+	/* Jobs whose deadline already passed are skipped, and missed too */
+	currThread->release += currThread->period;
+	while(currThread->release + currThread->relDeadline < now)
+	{
+		currThread->release += currThread->period;
+		missed++;
+	}
+	currThread->deadline = currThread->release + currThread->relDeadline;
 
-			/* If no more threads to schedule, break */
-			if(queue_length(threadQ) == 0)
-			{
-				break;
-			}
+	if(missed)
+	{
+		__atomic_add_fetch(&edfMisses, missed, __ATOMIC_RELAXED);
+	}
 
-			/* ctx_switch to new head, if new head is blocked yield */
-			struct uthread_tcb *newHead = threadQ->head->data;
-			newHead->state = RUNNING;
+	/* Late, the next job is already released */
+	if(currThread->release <= now)
+	{
+		preempt_enable();
+		uthread_yield();
+		return missed;
+	}
 
-			uthread_ctx_switch(&ctx[0], newHead->threadCtx);
-		}
+	pthread_mutex_lock(&runLock);
+	heap_push(&edfSleepQ, currThread->release, currThread);
+	if(edfNextRelease == 0 || currThread->release < edfNextRelease)
+	{
+		__atomic_store_n(&edfNextRelease, currThread->release,
+				 __ATOMIC_RELAXED);
 	}
+	pthread_mutex_unlock(&runLock);
 
-	/* Destroy the queues */
-	queue_destroy(threadQ);
+	uthread_block();
 
-	/* Restore timer and sigaction configurations */
-	if(preempt)
+	return missed;
+}
+
+/**
+ * @brief Put the current thread to sleep until a given time
+ *
+ * @param deadline CLOCK_MONOTONIC time (in ns) to sleep until
+ * @return int - 0 once the time has come, -1 if not called from a thread
+ */
+int uthread_sleep_until(uint64_t deadline)
+{
+	preempt_disable();
+
+	struct worker *worker = this_worker();
+	struct uthread_tcb *currThread = worker ? worker->current : NULL;
+	uint64_t wake;
+
+	if(currThread == NULL || deadline <= sched_now())
 	{
-		preempt_stop();
+		preempt_enable();
+		return currThread ? 0 : -1;
 	}
 
+	pthread_mutex_lock(&runLock);
+	wheel_add(&sleepWheel, &currThread->sleepTimer, deadline);
+	wheel_next(&sleepWheel, &wake);
+	__atomic_store_n(&sleepNextWake, wake, __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&runLock);
+
+	uthread_block();
+
 	return 0;
 }
 
 /**
- * @brief Current running thread can yield for other threads to execute
+ * @brief Put the current thread to sleep for a given time
+ *
+ * @param ns Time to sleep for (in ns)
+ * @return int - 0 once the time has passed, -1 if not called from a thread
+ */
+int uthread_sleep_ns(uint64_t ns)
+{
+	return uthread_sleep_until(sched_now() + ns);
+}
+
+/**
+ * @brief Get the number of deadlines missed by the threads of the deadline
+ * class
  *
  * @param none
- * @return none
+ * @return unsigned long - Number of deadlines missed since uthread_run()
+ * started
  */
-void uthread_yield(void)
+unsigned long uthread_deadline_misses(void)
+{
+	return __atomic_load_n(&edfMisses, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Create a thread-local storage key
+ *
+ * @param key Set to the new key
+ * @param destructor Function called with the value of the key of an exiting
+ * thread, may be NULL
+ * @return int - 0 in case of success, -1 if UTHREAD_KEYS_MAX keys were created
+ */
+int uthread_key_create(uthread_key_t *key, void (*destructor)(void *value))
 {
-	/* If there is only one thread in the queue, then we have no threads to yield to */
-	if(queue_length(threadQ) == 1)
+	preempt_disable();
+	spin_lock(&keyLock);
+	if(keyCount == UTHREAD_KEYS_MAX)
 	{
-		return;
+		spin_unlock(&keyLock);
+		preempt_enable();
+		return -1;
 	}
+	keyDestructors[keyCount] = destructor;
+	*key = keyCount;
+	__atomic_store_n(&keyCount, keyCount + 1, __ATOMIC_RELEASE);
+	spin_unlock(&keyLock);
+	preempt_enable();
 
-	void *popped;
+	return 0;
+}
+
+/**
+ * @brief Get the value of a thread-local key for the current thread
+ *
+ * @param key Key created with uthread_key_create()
+ * @return void* - Value of @key, NULL if none was set or @key is invalid
+ */
+void *uthread_getspecific(uthread_key_t key)
+{
+	void *value = NULL;
 
+	/*
+	 * Called for every lookup, so kept to a few loads: the thread read with
+	 * preemption disabled stays the current one, wherever it is resumed
+	 */
 	preempt_disable();
-	queue_dequeue(threadQ, &popped);
+	struct uthread_tcb *thread = thisWorker ? thisWorker->current : NULL;
+	if(thread && key >= 0 && key < SPECIFIC_INLINE)
+	{
+		value = thread->specific[key];
+	}
+	else if(thread && key >= 0 && key < UTHREAD_KEYS_MAX &&
+		thread->specificOverflow)
+	{
+		value = thread->specificOverflow[key - SPECIFIC_INLINE];
+	}
 	preempt_enable();
 
-	struct uthread_tcb *yieldingThread = popped;
-	struct uthread_tcb *newHead = threadQ->head->data;
+	return value;
+}
 
-	/* If yieldingThread hasn't finished, change to ready and re-enqueue */
-	if(yieldingThread->state == RUNNING || yieldingThread->state == READY)
-	{
-		yieldingThread->state = READY;
+/**
+ * @brief Set the value of a thread-local key for the current thread
+ *
+ * @param key Key created with uthread_key_create()
+ * @param value Value to set
+ * @return int - 0 in case of success, -1 in case of failure
+ */
+int uthread_setspecific(uthread_key_t key, const void *value)
+{
+	preempt_disable();
+	struct uthread_tcb *thread = uthread_current();
+	preempt_enable();
 
-		preempt_disable();
-		queue_enqueue(threadQ, yieldingThread);
-		preempt_enable();
+	if(thread == NULL || key < 0 ||
+	   key >= __atomic_load_n(&keyCount, __ATOMIC_ACQUIRE))
+	{
+		return -1;
 	}
 
-	newHead->state = RUNNING;
+	/* Only the thread itself touches its table, wherever it runs */
+	if(key >= SPECIFIC_INLINE && thread->specificOverflow == NULL)
+	{
+		if(value == NULL)
+		{
+			return 0;
+		}
+		thread->specificOverflow = calloc(UTHREAD_KEYS_MAX - SPECIFIC_INLINE,
+						  sizeof(void *));
+		if(thread->specificOverflow == NULL)
+		{
+			return -1;
+		}
+	}
 
-	uthread_ctx_switch(yieldingThread->threadCtx, newHead->threadCtx);
+	*specific_slot(thread, key) = (void *)value;
+	return 0;
 }
 
 /**
- * @brief Exit from the current running thread
+ * @brief Initialize thread creation attributes to their defaults
  *
- * @param none
+ * @param attr Attributes to initialize
  * @return none
  */
-void uthread_exit(void)
+void uthread_attr_init(uthread_attr_t *attr)
 {
-	if(uthread_current() == NULL)
+	attr->stack_size = UTHREAD_STACK_SIZE;
+	attr->guard_size = sysconf(_SC_PAGESIZE);
+	attr->priority = UTHREAD_PRIO_DEFAULT;
+	attr->weight = UTHREAD_WEIGHT_DEFAULT;
+	attr->period_us = 0;
+	attr->deadline_us = 0;
+}
+
+/**
+ * @brief Create a new thread
+ *
+ * @param func Function to be executed by created thread
+ * @param arg Arguments to be passed to the created thread
+ * @return uthread_tid_t - Identifier of the created thread, -1 in case of
+ * failure
+ */
+uthread_tid_t uthread_create(uthread_func_t func, void *arg)
+{
+	return uthread_create_attr(func, arg, NULL);
+}
+
+/**
+ * @brief Allocate and set up a new thread, not ready yet, preemption must be
+ * disabled
+ *
+ * @param func Function to be executed by created thread
+ * @param arg Arguments to be passed to the created thread
+ * @param attr Attributes of the created thread, already checked
+ * @return struct uthread_tcb of the new thread, NULL in case of failure
+ */
+static struct uthread_tcb *thread_new(uthread_func_t func, void *arg,
+				      const uthread_attr_t *attr)
+{
+	/* Make room for the new thread in the scheduler's heaps */
+	bool fair = schedPolicy == UTHREAD_SCHED_FAIR;
+	bool edf = attr->period_us != 0;
+	if((fair || edf) && thread_reserve(fair, edf))
 	{
-		exit(0);
+		return NULL;
 	}
 
-	struct uthread_tcb *currThread = uthread_current();
+	/* create new tcb */
+	spin_lock(&tcbLock);
+	struct uthread_tcb *newThread = slab_alloc(tcbCache);
+	if(newThread && tid_alloc(newThread))
+	{
+		slab_free(tcbCache, newThread);
+		newThread = NULL;
+	}
+	spin_unlock(&tcbLock);
+	if(newThread == NULL)
+	{
+		if(fair || edf)
+		{
+			thread_unreserve(fair, edf);
+		}
+		return NULL;
+	}
 
-	if(currThread->state == RUNNING || currThread->state == READY)
+	newThread->stackSize = attr->stack_size;
+	newThread->guardSize = attr->guard_size;
+	newThread->stackPointer = uthread_ctx_alloc_stack(newThread->stackSize,
+							  newThread->guardSize);
+	newThread->state = READY;
+	newThread->onCpu = 0;
+	newThread->link.prev = newThread->link.next = NULL;
+	newThread->retval = NULL;
+	newThread->joiner = NULL;
+	newThread->detached = false;
+	newThread->zombie = false;
+	newThread->priority = attr->priority;
+	newThread->level = fair ? UTHREAD_PRIO_DEFAULT : attr->priority;
+	newThread->vruntime = 0;
+	newThread->weight = attr->weight;
+	memset(newThread->specific, 0, sizeof(newThread->specific));
+	newThread->specificOverflow = NULL;
+
+	/* The first job of a thread of the deadline class is released right away */
+	newThread->period = attr->period_us * 1000;
+	newThread->relDeadline = (attr->deadline_us ? attr->deadline_us :
+				  attr->period_us) * 1000;
+	if(edf)
 	{
-		currThread->state = EXITED;
+		newThread->level = EDF_LEVEL;
+		newThread->release = sched_now();
+		newThread->deadline = newThread->release + newThread->relDeadline;
 	}
 
-	uthread_ctx_switch(currThread->threadCtx, &ctx[0]);
+	if(newThread->stackPointer == NULL ||
+	   uthread_ctx_init(&newThread->ctx, newThread->stackPointer,
+			    newThread->stackSize, func, arg))
+	{
+		if(newThread->stackPointer)
+		{
+			uthread_ctx_destroy_stack(newThread->stackPointer,
+						  newThread->stackSize, newThread->guardSize);
+		}
+		spin_lock(&tcbLock);
+		tid_free(newThread);
+		slab_free(tcbCache, newThread);
+		spin_unlock(&tcbLock);
+		if(fair || edf)
+		{
+			thread_unreserve(fair, edf);
+		}
+		return NULL;
+	}
 
-	exit(0);
+	return newThread;
 }
 
 /**
- * @brief Create a new thread
+ * @brief Create a new thread with specific attributes
  *
  * @param func Function to be executed by created thread
  * @param arg Arguments to be passed to the created thread
- * @return none
+ * @param attr Attributes of the created thread, NULL for the defaults
+ * @return uthread_tid_t - Identifier of the created thread, -1 in case of
+ * failure
  */
-int uthread_create(uthread_func_t func, void *arg)
+uthread_tid_t uthread_create_attr(uthread_func_t func, void *arg,
+				  const uthread_attr_t *attr)
 {
-	/* create new tcb */
-	struct uthread_tcb *newThread = malloc(sizeof(struct uthread_tcb));
-	newThread->threadCtx = uthread_ctx_alloc_stack();
-	newThread->stackPointer = uthread_ctx_alloc_stack();
-	newThread->state = READY;
+	uthread_attr_t defaultAttr;
+
+	if(attr == NULL)
+	{
+		uthread_attr_init(&defaultAttr);
+		attr = &defaultAttr;
+	}
 
-	if(uthread_ctx_init(newThread->threadCtx, newThread->stackPointer, func, arg) || newThread == NULL)
+	if(func == NULL || attr->stack_size < UTHREAD_STACK_MIN ||
+	   attr->priority < UTHREAD_PRIO_MIN || attr->priority > UTHREAD_PRIO_MAX ||
+	   attr->weight < UTHREAD_WEIGHT_MIN || attr->weight > UTHREAD_WEIGHT_MAX ||
+	   attr->deadline_us > attr->period_us)
 	{
 		return -1;
 	}
 
 	preempt_disable();
-	queue_enqueue(threadQ, newThread);
-	preempt_enable();
+	struct uthread_tcb *newThread = thread_new(func, arg, attr);
+	if(newThread == NULL)
+	{
+		preempt_enable();
+		return -1;
+	}
 
-	return 0;
+	/* The thread may run, and even exit, before thread_wake() returns */
+	uthread_tid_t tid = newThread->tid;
+	thread_wake(newThread);
+
+	return tid;
+}
+
+/**
+ * @brief Create a detached thread with the default attributes, for the
+ * scheduler to make ready, preemption must be disabled
+ *
+ * @param func Function to be executed by created thread
+ * @param arg Arguments to be passed to the created thread
+ * @return struct uthread_tcb of the new thread, NULL in case of failure
+ */
+struct uthread_tcb *uthread_create_detached(uthread_func_t func, void *arg)
+{
+	uthread_attr_t attr;
+
+	uthread_attr_init(&attr);
+	struct uthread_tcb *newThread = thread_new(func, arg, &attr);
+	if(newThread)
+	{
+		newThread->detached = true;
+	}
+
+	return newThread;
 }
 
 /**
- * @brief Block current running thread
+ * @brief Block current running thread, preemption must be disabled
  *
  * @param none
  * @return none
  */
 void uthread_block(void)
 {
-	uthread_current()->state = BLOCKED;
-	uthread_yield();
+	struct worker *worker = this_worker();
+	struct uthread_tcb *currThread = worker->current;
+
+	if(schedPolicy == UTHREAD_SCHED_FAIR)
+	{
+		fair_charge(currThread);
+	}
+
+	/* Unless currThread was already unblocked */
+	int running = RUNNING;
+	__atomic_compare_exchange_n(&currThread->state, &running, BLOCKED, false,
+				    __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+
+	struct uthread_tcb *newThread = thread_pick(worker, UTHREAD_PRIO_MIN);
+
+	/* If currThread was already unblocked and is next in line, keep running */
+	if(newThread == currThread)
+	{
+		currThread->state = RUNNING;
+		if(schedPolicy == UTHREAD_SCHED_FAIR)
+		{
+			fair_start(currThread);
+		}
+	}
+	else
+	{
+		uthread_switch(worker, currThread, newThread);
+	}
+	preempt_enable();
 }
 
 /**
- * @brief Unblock current running thread
+ * @brief Unblock a blocked thread
  *
  * @param uthread TCB of thread we want to unblock
  * @return none
  */
 void uthread_unblock(struct uthread_tcb *uthread)
 {
-	uthread->state = READY;
+	/* MLFQ gives the threads that wait their priority back */
+	if(schedPolicy == UTHREAD_SCHED_MLFQ && uthread->level != EDF_LEVEL)
+	{
+		uthread->level = uthread->priority;
+	}
+
+	preempt_disable();
+	thread_wake(uthread);
+}
+
+/**
+ * @brief Unblock a blocked thread and switch to it, when it may run first
+ *
+ * @param uthread TCB of thread we want to unblock
+ * @return none
+ */
+void uthread_unblock_handoff(struct uthread_tcb *uthread)
+{
+	if(schedPolicy == UTHREAD_SCHED_MLFQ && uthread->level != EDF_LEVEL)
+	{
+		uthread->level = uthread->priority;
+	}
 
 	preempt_disable();
-	queue_enqueue(threadQ, uthread);
+
+	struct worker *worker = this_worker();
+	struct uthread_tcb *currThread = worker ? worker->current : NULL;
+
+	/*
+	 * A thread that did not get to block yet is made ready as usual, and so is
+	 * one that would not run before the current thread. Only the thread
+	 * unblocking it can make it ready, so it cannot stop being blocked here.
+	 * Neither does it wait for another worker to finish switching away from
+	 * the thread, which may take a while if that worker's kernel thread got
+	 * preempted.
+	 */
+	if(currThread == NULL || schedPolicy == UTHREAD_SCHED_FAIR ||
+	   __atomic_load_n(&uthread->state, __ATOMIC_RELAXED) != BLOCKED ||
+	   __atomic_load_n(&uthread->onCpu, __ATOMIC_RELAXED) ||
+	   uthread->level < currThread->level ||
+	   (uthread->level == EDF_LEVEL &&
+	    uthread->deadline > currThread->deadline))
+	{
+		thread_wake(uthread);
+		return;
+	}
+
+	/*
+	 * Hand the worker over, like a yield that chose its successor. The current
+	 * thread is only made ready once switched away from, so that no other
+	 * worker picks it and waits for it to be saved.
+	 */
+	worker->readyPrev = true;
+	uthread_switch(worker, currThread, uthread);
 	preempt_enable();
 }
@@ -2,6 +2,8 @@
 #define _UTHREAD_H
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 /*
  * uthread_func_t - Thread function type
@@ -9,6 +11,92 @@
  */
 typedef void (*uthread_func_t)(void *arg);
 
+/*
+ * uthread_tid_t - Thread identifier
+ *
+ * Identifies a thread from its creation until it is joined, or until it exits
+ * if it is detached. Identifiers are positive, and the identifier of a thread
+ * that is gone goes on matching no thread, even once another thread reuses its
+ * memory.
+ */
+typedef long uthread_tid_t;
+
+/*
+ * uthread_key_t - Thread-local storage key
+ *
+ * UTHREAD_KEYS_MAX - Number of keys a program can create
+ */
+typedef int uthread_key_t;
+#define UTHREAD_KEYS_MAX 128
+
+/*
+ * UTHREAD_STACK_MIN - Smallest stack a thread can be created with (in bytes)
+ */
+#define UTHREAD_STACK_MIN 4096
+
+/*
+ * UTHREAD_PRIO_MIN, UTHREAD_PRIO_MAX - Range of thread priorities
+ * UTHREAD_PRIO_DEFAULT - Priority of threads created with default attributes
+ *
+ * A higher number is a higher priority. A thread only runs when no thread of a
+ * higher priority is ready to run, and threads of the same priority take turns.
+ */
+#define UTHREAD_PRIO_MIN 0
+#define UTHREAD_PRIO_MAX 7
+#define UTHREAD_PRIO_DEFAULT 4
+
+/*
+ * UTHREAD_WEIGHT_MIN, UTHREAD_WEIGHT_MAX - Range of thread weights
+ * UTHREAD_WEIGHT_DEFAULT - Weight of threads created with default attributes
+ *
+ * With the fair scheduling policy, threads get a share of the CPU proportional
+ * to their weight.
+ */
+#define UTHREAD_WEIGHT_MIN 1
+#define UTHREAD_WEIGHT_MAX 1048576
+#define UTHREAD_WEIGHT_DEFAULT 1024
+
+/*
+ * uthread_attr_t - Thread creation attributes
+ * @stack_size: Size of the thread's stack (in bytes), at least
+ *	UTHREAD_STACK_MIN. Stack memory is only committed as the thread touches
+ *	it, so a large stack mostly costs address space.
+ * @guard_size: Size of the inaccessible area placed below the stack (in bytes),
+ *	rounded up to a multiple of the page size. A thread overflowing its stack
+ *	into this area is killed by a segmentation fault. Each guarded stack
+ *	costs an extra memory mapping, so programs running a very large number of
+ *	threads may need to set this to 0.
+ * @priority: Priority of the thread, from UTHREAD_PRIO_MIN to
+ *	UTHREAD_PRIO_MAX
+ * @weight: Weight of the thread under the fair scheduling policy, from
+ *	UTHREAD_WEIGHT_MIN to UTHREAD_WEIGHT_MAX
+ * @period_us: Period of the thread (in microseconds), or 0. A thread with a
+ *	period belongs to the deadline class: it runs one job per period, and
+ *	calls uthread_wait_period() at the end of each job.
+ * @deadline_us: Time after the start of each period by which the job must be
+ *	done (in microseconds), at most @period_us, or 0 for @period_us
+ *
+ * Attributes must be initialized to their default values with
+ * uthread_attr_init() before being changed.
+ */
+typedef struct uthread_attr {
+	size_t stack_size;
+	size_t guard_size;
+	int priority;
+	unsigned int weight;
+	unsigned long period_us;
+	unsigned long deadline_us;
+} uthread_attr_t;
+
+/*
+ * uthread_attr_init - Initialize thread creation attributes
+ * @attr: Attributes to initialize
+ *
+ * Set @attr to the default attributes: a 32 KiB stack, with a one page guard
+ * area, the default priority and weight, and no period.
+ */
+void uthread_attr_init(uthread_attr_t *attr);
+
 /*
  * uthread_run - Run the multithreading library
  * @preempt: Preemption enable
@@ -26,18 +114,113 @@ typedef void (*uthread_func_t)(void *arg);
  */
 int uthread_run(bool preempt, uthread_func_t func, void *arg);
 
+/*
+ * uthread_run_workers - Run the multithreading library on several CPUs
+ * @nworkers: Number of kernel threads running the threads, or 0 for one per
+ *	online CPU
+ * @preempt: Preemption enable
+ * @func: Function of the first thread to start
+ * @arg: Argument to be passed to the first thread
+ *
+ * Same as uthread_run(), except that the threads are run by @nworkers kernel
+ * threads (workers) at once: the calling thread and @nworkers - 1 pthreads. The
+ * workers take the threads to run from a shared queue of ready threads, so a
+ * thread may be resumed by another worker than the one it last ran on.
+ * uthread_run() is the same as running a single worker.
+ *
+ * Threads running on different workers run in parallel, so the data they share
+ * must be protected, e.g. with semaphores.
+ *
+ * Return: 0 in case of success, -1 in case of failure (e.g., memory allocation,
+ * context creation).
+ */
+int uthread_run_workers(size_t nworkers, bool preempt, uthread_func_t func,
+			void *arg);
+
 /*
  * uthread_create - Create a new thread
  * @func: Function to be executed by the thread
  * @arg: Argument to be passed to the thread
  *
  * This function creates a new thread running the function @func to which
- * argument @arg is passed.
+ * argument @arg is passed. The thread is joinable: once it exits, its TCB stays
+ * around until another thread collects its return value with uthread_join(),
+ * unless it is detached with uthread_detach().
  *
- * Return: 0 in case of success, -1 in case of failure (e.g., memory allocation,
- * context creation).
+ * Return: Identifier of the new thread in case of success, -1 in case of
+ * failure (e.g., memory allocation, context creation).
  */
-int uthread_create(uthread_func_t func, void *arg);
+uthread_tid_t uthread_create(uthread_func_t func, void *arg);
+
+/*
+ * uthread_create_attr - Create a new thread with specific attributes
+ * @func: Function to be executed by the thread
+ * @arg: Argument to be passed to the thread
+ * @attr: Attributes of the new thread, or NULL for the default attributes
+ *
+ * This function creates a new thread running the function @func to which
+ * argument @arg is passed, as described by @attr.
+ *
+ * Return: Identifier of the new thread in case of success, -1 in case of
+ * failure (e.g., invalid attributes, memory allocation, context creation).
+ */
+uthread_tid_t uthread_create_attr(uthread_func_t func, void *arg,
+				  const uthread_attr_t *attr);
+
+/*
+ * uthread_create_external - Create a new thread from outside of the threads
+ * @func: Function to be executed by the thread
+ * @arg: Argument to be passed to the thread
+ *
+ * Can be called from any kernel thread, like the callback of a library running
+ * its own pthreads, while a run is going. The thread is created, detached and
+ * with the default attributes, by the scheduler soon after; if it cannot be
+ * created then, @func does not run. See uthread_external_hold() to keep the run
+ * going until then.
+ *
+ * Return: 0 if the creation was posted, -1 if @func is NULL or in case of
+ * memory allocation error
+ */
+int uthread_create_external(uthread_func_t func, void *arg);
+
+/*
+ * uthread_external_hold - Keep the run going for other kernel threads
+ *
+ * A run is over once no thread can become ready anymore, even if threads are
+ * blocked on a semaphore that another kernel thread is about to release with
+ * sem_up_external(). Until the matching uthread_external_release(), the run
+ * goes on instead, the idle workers waiting for messages from other kernel
+ * threads. Both functions can be called from any kernel thread.
+ */
+void uthread_external_hold(void);
+
+/*
+ * uthread_external_release - Let the run end again
+ *
+ * Drops a reference taken with uthread_external_hold(). Messages posted before
+ * are still carried out.
+ */
+void uthread_external_release(void);
+
+/*
+ * uthread_offload - Run a function that blocks on a helper kernel thread
+ * @func: Function to run
+ * @arg: Argument of @func
+ *
+ * For calls that cannot be made non-blocking, like fsync(), getaddrinfo() or
+ * open() on a slow file system: @func runs on one of a small pool of helper
+ * kernel threads, started on first use, while the calling thread blocks and
+ * the others keep running. Once @func returns, its helper posts to the
+ * scheduler's inbox, like uthread_create_external() does, to unblock the
+ * thread. Calls wait for a free helper in FIFO order.
+ *
+ * @func must not call the functions of the library, and runs with every signal
+ * blocked. Called from outside of a thread, @func simply runs on the calling
+ * kernel thread.
+ *
+ * Return: Value returned by @func
+ */
+void *uthread_offload(void *(*func)(void *), void *arg);
 
 /*
  * uthread_yield - Yield execution
@@ -47,14 +230,247 @@ int uthread_create(uthread_func_t func, void *arg);
  */
 void uthread_yield(void);
 
+/*
+ * uthread_yield_to - Yield execution to a specific thread
+ * @tid: Identifier of the thread to run next
+ *
+ * Same as uthread_yield(), except that thread @tid runs next in a single
+ * context switch, whatever its priority and its place among the ready threads.
+ * The calling thread is queued as if it had yielded.
+ *
+ * Only threads waiting in the run queue can be yielded to. This leaves out the
+ * threads of the fair policy and of the deadline class, which are ordered by
+ * other means, and, with several workers, the threads of the default priority
+ * made ready by another thread, which wait in a worker's deque.
+ *
+ * Return: 0 once the calling thread runs again, -1 if @tid is not a thread
+ * that can be yielded to or if not called from a thread
+ */
+int uthread_yield_to(uthread_tid_t tid);
+
+/*
+ * uthread_self - Get the identifier of the running thread
+ *
+ * Return: Identifier of the calling thread, -1 if not called from a thread
+ */
+uthread_tid_t uthread_self(void);
+
 /*
  * uthread_exit - Exit from currently running thread
+ * @retval: Return value of the thread, for uthread_join()
  *
  * This function is to be called from the currently active and running thread in
- * order to finish its execution.
+ * order to finish its execution. Returning from the thread's function is the
+ * same as calling uthread_exit(NULL).
  *
  * This function shall never return.
  */
-void uthread_exit(void);
+void uthread_exit(void *retval);
+
+/*
+ * uthread_join - Wait for a thread to exit
+ * @tid: Identifier of the thread to wait for
+ * @retval: Set to the return value of the thread, may be NULL
+ *
+ * Block the calling thread until thread @tid exits, unless it already has, and
+ * free what is left of it. A thread can only be joined once, by one thread.
+ *
+ * Return: 0 in case of success, -1 if @tid is not a joinable thread (e.g.,
+ * invalid, detached, already being joined, the caller itself) or if not called
+ * from a thread
+ */
+int uthread_join(uthread_tid_t tid, void **retval);
+
+/*
+ * uthread_detach - Detach a thread
+ * @tid: Identifier of the thread to detach
+ *
+ * Have thread @tid freed as soon as it exits, instead of waiting to be joined.
+ * If it already exited, it is freed right away.
+ *
+ * Return: 0 in case of success, -1 if @tid is not a joinable thread
+ */
+int uthread_detach(uthread_tid_t tid);
+
+/*
+ * uthread_sleep_until - Sleep until a given time
+ * @deadline: CLOCK_MONOTONIC time to wake up at (in ns)
+ *
+ * Block the calling thread until @deadline, letting the other threads run.
+ * Sleeping threads wake up with a resolution of about 131 us, never early, and
+ * are then queued like any thread made ready. A worker left with nothing to run
+ * blocks in the kernel until the next sleeping thread wakes up. With
+ * preemption enabled, the running thread is interrupted when a sleeping thread
+ * wakes up, so that it is queued on time; otherwise, that only happens once
+ * the running thread yields or blocks. If @deadline is already past, returns
+ * right away.
+ *
+ * Return: 0 once @deadline has passed, -1 if not called from a thread
+ */
+int uthread_sleep_until(uint64_t deadline);
+
+/*
+ * uthread_sleep_ns - Sleep for a given time
+ * @ns: Time to sleep for (in ns)
+ *
+ * Same as uthread_sleep_until(), @ns after the current time.
+ *
+ * Return: 0 once @ns have passed, -1 if not called from a thread
+ */
+int uthread_sleep_ns(uint64_t ns);
+
+/*
+ * uthread_key_create - Create a thread-local storage key
+ * @key: Set to the new key
+ * @destructor: Function called with the value of the key of a thread that
+ *	exits, if not NULL, or NULL for none
+ *
+ * Every thread has its own value for the key, NULL at first. When a thread
+ * exits, the destructor of each key whose value is not NULL is called with it,
+ * after the value is set back to NULL. If destructors set values again, they
+ * are called again, up to four rounds. Keys last for the whole program.
+ *
+ * Return: 0 in case of success, or -1 if UTHREAD_KEYS_MAX keys were created
+ */
+int uthread_key_create(uthread_key_t *key, void (*destructor)(void *value));
+
+/*
+ * uthread_getspecific - Get the value of a key for the current thread
+ * @key: Key created with uthread_key_create()
+ *
+ * The first keys are stored inline in the thread, so that looking them up
+ * takes a couple of loads; the others take one more.
+ *
+ * Return: Value of @key, or NULL if none was set, if @key is invalid, or if not
+ * called from a thread
+ */
+void *uthread_getspecific(uthread_key_t key);
+
+/*
+ * uthread_setspecific - Set the value of a key for the current thread
+ * @key: Key created with uthread_key_create()
+ * @value: Value to set
+ *
+ * Return: 0 in case of success, or -1 if @key is invalid, in case of memory
+ * allocation error, or if not called from a thread
+ */
+int uthread_setspecific(uthread_key_t key, const void *value);
+
+/*
+ * uthread_set_priority - Change the priority of the running thread
+ * @priority: New priority, from UTHREAD_PRIO_MIN to UTHREAD_PRIO_MAX
+ *
+ * If the priority is lowered, the thread yields to the threads that now have a
+ * higher priority than itself.
+ *
+ * Return: 0 in case of success, -1 if @priority is invalid or if not called
+ * from a thread
+ */
+int uthread_set_priority(int priority);
+
+/*
+ * uthread_sched_t - Scheduling policy
+ * @UTHREAD_SCHED_RR: Threads keep the priority they were given, and threads of
+ *	the same priority run in round-robin order.
+ * @UTHREAD_SCHED_MLFQ: Multi-level feedback queue. The priority given to a
+ *	thread is the highest it can run at: a thread that uses up a whole time
+ *	slice of preemption drops one priority level, down to UTHREAD_PRIO_MIN,
+ *	and a thread waking up from a semaphore goes back to its own priority, so
+ *	that threads that mostly wait run ahead of those that mostly compute.
+ *	Every 100 ms, the ready threads that were demoted get their priority back
+ *	so that they cannot starve.
+ * @UTHREAD_SCHED_FAIR: Fair share. Each thread is charged for the time it runs,
+ *	divided by its weight, and the thread charged the least runs next, so
+ *	that threads get a share of the CPU proportional to their weight whether
+ *	they yield early or wait for preemption. A thread that was blocked starts
+ *	again from the least charged ready thread, without credit for the time it
+ *	did not run. Priorities are ignored, and all the workers share a single
+ *	queue of ready threads.
+ */
+typedef enum uthread_sched {
+	UTHREAD_SCHED_RR,
+	UTHREAD_SCHED_MLFQ,
+	UTHREAD_SCHED_FAIR,
+} uthread_sched_t;
+
+/*
+ * uthread_set_sched - Configure the scheduling policy
+ * @policy: Scheduling policy
+ *
+ * The policy is used by the following calls to uthread_run() and
+ * uthread_run_workers(). The default policy is UTHREAD_SCHED_RR. Demoting
+ * threads requires preemption.
+ *
+ * Return: 0 in case of success, -1 if @policy is invalid
+ */
+int uthread_set_sched(uthread_sched_t policy);
+
+/*
+ * uthread_wait_period - Wait for the next period
+ *
+ * This function is to be called by a thread of the deadline class once the
+ * job of its current period is done. The thread sleeps until its next period
+ * starts. Threads of the deadline class run before all the other threads,
+ * whatever the scheduling policy, the one with the earliest deadline first. A
+ * thread whose job is released preempts the running thread as soon as the
+ * preemption timer can fire, if preemption is enabled.
+ *
+ * A job done after its deadline counts as a missed deadline. So do the jobs of
+ * the periods that went by entirely before the thread was done: these periods
+ * are skipped.
+ *
+ * Return: Number of deadlines missed since the previous call, or -1 if the
+ * current thread is not of the deadline class
+ */
+int uthread_wait_period(void);
+
+/*
+ * uthread_deadline_misses - Number of missed deadlines
+ *
+ * Return: Number of deadlines missed by all the threads of the deadline class
+ * since uthread_run() or uthread_run_workers() started
+ */
+unsigned long uthread_deadline_misses(void);
+
+/*
+ * uthread_set_stack_cache - Configure the stack pool
+ * @high_water: Number of idle stacks kept ready for reuse, per stack size
+ *
+ * The stacks of exited threads are kept in a pool from which new threads take
+ * their stack. Up to @high_water idle stacks of each size are kept as they are;
+ * idle stacks above that mark are trimmed: their memory is given back to the
+ * system until they get reused. The default mark is 64 stacks per size.
+ */
+void uthread_set_stack_cache(size_t high_water);
+
+/*
+ * uthread_clock_t - Clock measuring the time slices of preemption
+ * @UTHREAD_CLOCK_CPU: CPU time of the kernel thread running the thread. Time
+ *	the thread spends blocked in a system call is not counted against its
+ *	time slice. The kernel only checks CPU time timers on its scheduler tick,
+ *	so slices are at least one tick long (1 to 10 ms depending on the kernel
+ *	configuration).
+ * @UTHREAD_CLOCK_MONOTONIC: Elapsed time, with high resolution timers. A
+ *	thread can lose the CPU while it is blocked in a system call.
+ */
+typedef enum uthread_clock {
+	UTHREAD_CLOCK_CPU,
+	UTHREAD_CLOCK_MONOTONIC,
+} uthread_clock_t;
+
+/*
+ * uthread_set_preemption - Configure the time slice of preemption
+ * @quantum_us: Length of the time slice (in microseconds)
+ * @clock: Clock measuring the time slice
+ *
+ * When preemption is enabled, a thread that has been running for @quantum_us
+ * microseconds on @clock is forced to yield. Each worker has its own timer,
+ * which only interrupts that worker. The configuration is used by the following
+ * calls to uthread_run() and uthread_run_workers(). The default time slice is
+ * 10 ms of CPU time.
+ *
+ * Return: 0 in case of success, -1 if @quantum_us is 0 or @clock is invalid
+ */
+int uthread_set_preemption(unsigned long quantum_us, uthread_clock_t clock);
 
 #endif /* _THREAD_H */
@@ -0,0 +1,232 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "list.h"
+#include "private.h"
+
+/* Number of ticks the slots of @level span */
+#define LEVEL_TICKS(level) (1ULL << (WHEEL_BITS * (level)))
+
+/* Furthest a timer can be placed from now (in ticks) */
+#define WHEEL_SPAN (LEVEL_TICKS(WHEEL_LEVELS) - 1)
+
+/**
+ * @brief Put an armed timer in the slot it belongs to, given the current tick
+ *
+ * @param wheel Wheel to put @timer in
+ * @param timer Timer expiring on tick @timer->expiry, not before the current
+ * tick
+ * @return none
+ */
+static void wheel_place(struct wheel *wheel, struct wheel_timer *timer)
+{
+	uint64_t expiry = timer->expiry;
+	uint64_t delta = expiry - wheel->now;
+	int level = 0;
+
+	/* Park timers beyond the span in the last slot, they get placed again */
+	if(delta > WHEEL_SPAN)
+	{
+		delta = WHEEL_SPAN;
+		expiry = wheel->now + WHEEL_SPAN;
+	}
+
+	while(level < WHEEL_LEVELS - 1 && delta >= LEVEL_TICKS(level + 1))
+	{
+		level++;
+	}
+
+	unsigned int index = (expiry >> (WHEEL_BITS * level)) & (WHEEL_SLOTS - 1);
+
+	timer->slot = &wheel->slots[level][index];
+	list_push_back(timer->slot, &timer->link);
+	wheel->occupied[level] |= 1ULL << index;
+}
+
+/**
+ * @brief Get the first tick after the current one at which something happens
+ * in @wheel: a timer expires, or a slot holding timers is cascaded
+ *
+ * @param wheel Wheel to look into
+ * @param tick Set to the tick
+ * @return Returns true if @wheel holds timers, false otherwise
+ */
+static bool wheel_next_tick(const struct wheel *wheel, uint64_t *tick)
+{
+	bool found = false;
+
+	for(int level = 0; level < WHEEL_LEVELS; level++)
+	{
+		uint64_t occupied = wheel->occupied[level];
+		if(occupied == 0)
+		{
+			continue;
+		}
+
+		/*
+		 * Look from the slot after the current one, the current one coming
+		 * last: its timers were placed a whole round of the level ahead
+		 */
+		uint64_t current = wheel->now >> (WHEEL_BITS * level);
+		unsigned int shift = (current + 1) & (WHEEL_SLOTS - 1);
+		uint64_t rotated = occupied >> shift |
+			occupied << ((WHEEL_SLOTS - shift) & (WHEEL_SLOTS - 1));
+		uint64_t next = (current + 1 + __builtin_ctzll(rotated)) <<
+			(WHEEL_BITS * level);
+
+		if(!found || next < *tick)
+		{
+			*tick = next;
+			found = true;
+		}
+	}
+
+	return found;
+}
+
+/**
+ * @brief Initialize an empty timing wheel
+ *
+ * @param wheel Wheel to initialize
+ * @param now Current time (in ns)
+ * @return none
+ */
+void wheel_init(struct wheel *wheel, uint64_t now)
+{
+	for(int level = 0; level < WHEEL_LEVELS; level++)
+	{
+		for(int index = 0; index < WHEEL_SLOTS; index++)
+		{
+			list_init(&wheel->slots[level][index]);
+		}
+		wheel->occupied[level] = 0;
+	}
+
+	wheel->now = now >> WHEEL_TICK_SHIFT;
+	wheel->length = 0;
+}
+
+/**
+ * @brief Arm a timer
+ *
+ * @param wheel Wheel to add @timer to
+ * @param timer Timer to arm
+ * @param when Time at which @timer expires (in ns)
+ * @return none
+ */
+void wheel_add(struct wheel *wheel, struct wheel_timer *timer, uint64_t when)
+{
+	/* Round up, so that the timer does not expire early */
+	timer->expiry = (when + (1ULL << WHEEL_TICK_SHIFT) - 1) >> WHEEL_TICK_SHIFT;
+	if(timer->expiry <= wheel->now)
+	{
+		timer->expiry = wheel->now + 1;
+	}
+
+	wheel_place(wheel, timer);
+	wheel->length++;
+}
+
+/**
+ * @brief Disarm a timer
+ *
+ * @param wheel Wheel @timer was added to
+ * @param timer Timer to disarm, does nothing if it is not armed anymore
+ * @return none
+ */
+void wheel_cancel(struct wheel *wheel, struct wheel_timer *timer)
+{
+	if(timer->slot == NULL)
+	{
+		return;
+	}
+
+	list_remove(timer->slot, &timer->link);
+	if(list_length(timer->slot) == 0)
+	{
+		size_t index = timer->slot - &wheel->slots[0][0];
+
+		wheel->occupied[index / WHEEL_SLOTS] &=
+			~(1ULL << (index % WHEEL_SLOTS));
+	}
+
+	timer->slot = NULL;
+	wheel->length--;
+}
+
+/**
+ * @brief Move time forward, and collect the timers that expired
+ *
+ * Only the ticks at which something happens are visited, so advancing over a
+ * long time costs no more than over a short one.
+ *
+ * @param wheel Wheel to advance
+ * @param now Current time (in ns)
+ * @param expired List to move the expired timers to
+ * @return none
+ */
+void wheel_advance(struct wheel *wheel, uint64_t now, struct list *expired)
+{
+	uint64_t target = now >> WHEEL_TICK_SHIFT;
+	uint64_t tick;
+
+	while(wheel->now < target)
+	{
+		if(!wheel_next_tick(wheel, &tick) || tick > target)
+		{
+			wheel->now = target;
+			break;
+		}
+		wheel->now = tick;
+
+		/* Cascade the slots of the levels whose round starts on this tick */
+		for(int level = 1; level < WHEEL_LEVELS &&
+		    (tick & (LEVEL_TICKS(level) - 1)) == 0; level++)
+		{
+			unsigned int index = (tick >> (WHEEL_BITS * level)) &
+				(WHEEL_SLOTS - 1);
+			struct list *slot = &wheel->slots[level][index];
+			struct list_node *node;
+
+			wheel->occupied[level] &= ~(1ULL << index);
+			while((node = list_pop_front(slot)))
+			{
+				wheel_place(wheel, list_entry(node, struct wheel_timer, link));
+			}
+		}
+
+		/* Then expire the timers of the tick */
+		unsigned int index = tick & (WHEEL_SLOTS - 1);
+		struct list *slot = &wheel->slots[0][index];
+		struct list_node *node;
+
+		wheel->occupied[0] &= ~(1ULL << index);
+		while((node = list_pop_front(slot)))
+		{
+			list_entry(node, struct wheel_timer, link)->slot = NULL;
+			list_push_back(expired, node);
+			wheel->length--;
+		}
+	}
+}
+
+/**
+ * @brief Get the time at which a wheel next needs advancing
+ *
+ * @param wheel Wheel to look into
+ * @param when Set to the time (in ns) at which the next timer expires, or at
+ * which a timer needs to be cascaded
+ * @return Returns true if @wheel holds timers, false otherwise
+ */
+bool wheel_next(const struct wheel *wheel, uint64_t *when)
+{
+	uint64_t tick;
+
+	if(!wheel_next_tick(wheel, &tick))
+	{
+		return false;
+	}
+
+	*when = tick << WHEEL_TICK_SHIFT;
+	return true;
+}